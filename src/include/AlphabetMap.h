@@ -0,0 +1,166 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <stdexcept>
+
+#include "BinaryStream.h"
+#include "CodecUTF8.h"
+
+/**
+ * Dense alphabet of a string
+ * characters are replaced with their ranks in the sorted alphabet, so codecs can work on arrays
+ * of uint8_t (at most 256 characters) or uint16_t (at most 65536) instead of char32_t.
+ * ranks are found with a table of pages of 256 code points (only the pages of the alphabet are kept)
+*/
+class AlphabetMap
+{
+public:
+    AlphabetMap() = default;
+    // sorted alphabet of the string
+    explicit AlphabetMap(const std::u32string_view& str);
+
+    const std::u32string& GetAlphabet() const { return alphabet; }
+    size_t GetSize() const { return alphabet.size(); }
+
+    // rank of the character of the alphabet (defined in the class to be inlined into encoding loops)
+    uint32_t GetRank(const char32_t& c) const {
+        return pageRanks[(size_t(pageIndices[c >> PAGE_BITS]) << PAGE_BITS) | (c & PAGE_MASK)];
+    }
+    // ranks of the characters of the string (all of them must be in the alphabet)
+    template <typename rankType>
+    std::vector<rankType> GetRanks(const std::u32string_view& str) const;
+    // call function with the ranks of the string in the smallest type
+    template <typename Function>
+    void VisitRanks(const std::u32string_view& str, Function function) const;
+    // UTF-8 string of the characters with these ranks
+    template <typename rankType>
+    std::string GetUTF8String(const rankType* ranks, const size_t& size) const;
+
+    // the alphabet is stored as its length (uint32_t) and its UTF-8 characters
+    void Write(BinaryWriter& writer) const;
+    static AlphabetMap Read(BinaryReader& reader);
+protected:
+    static constexpr char32_t MAX_CODE_POINT = 0x10FFFF;
+    static constexpr uint8_t PAGE_BITS = 8;
+    static constexpr char32_t PAGE_MASK = (1 << PAGE_BITS) - 1;
+    static constexpr size_t MAX_CHAR_LENGTH = 4;
+
+    void BuildTables();
+
+    std::u32string alphabet;
+    // page of the code point >> PAGE_BITS in pageRanks (pages which aren't used point to the page 0)
+    std::vector<uint32_t> pageIndices;
+    std::vector<uint32_t> pageRanks;
+    // UTF-8 bytes of the characters (MAX_CHAR_LENGTH for every rank) and their lengths
+    std::vector<uint8_t> charBytes;
+    std::vector<uint8_t> charLengths;
+};
+
+
+// START IMPLEMENTATION
+
+
+AlphabetMap::AlphabetMap(const std::u32string_view& str)
+{
+    // one pass over the string marks the code points, the marks are read in order
+    std::vector<uint64_t> usedCodePoints((MAX_CODE_POINT >> 6) + 1, 0);
+    for (char32_t c : str) {
+        if (c > MAX_CODE_POINT) {
+            throw std::runtime_error("Wrong code point");
+        }
+        usedCodePoints[c >> 6] |= uint64_t(1) << (c & 63);
+    }
+    for (size_t i = 0; i < usedCodePoints.size(); ++i) {
+        if (usedCodePoints[i] == 0) {
+            continue;
+        }
+        for (uint8_t bit = 0; bit < 64; ++bit) {
+            if ((usedCodePoints[i] >> bit) & 1) {
+                alphabet.push_back(static_cast<char32_t>((i << 6) | bit));
+            }
+        }
+    }
+    BuildTables();
+}
+
+void AlphabetMap::BuildTables()
+{
+    pageIndices.assign((MAX_CODE_POINT >> PAGE_BITS) + 1, 0);
+    pageRanks.assign(size_t(1) << PAGE_BITS, 0);
+    charBytes.assign(MAX_CHAR_LENGTH * alphabet.size(), 0);
+    charLengths.resize(alphabet.size());
+    for (uint32_t rank = 0; rank < alphabet.size(); ++rank) {
+        char32_t c = alphabet[rank];
+        if (c > MAX_CODE_POINT) {
+            throw std::runtime_error("Wrong code point");
+        }
+        uint32_t& page = pageIndices[c >> PAGE_BITS];
+        if (page == 0) {
+            page = static_cast<uint32_t>(pageRanks.size() >> PAGE_BITS);
+            pageRanks.resize(pageRanks.size() + (size_t(1) << PAGE_BITS), 0);
+        }
+        pageRanks[(size_t(page) << PAGE_BITS) | (c & PAGE_MASK)] = rank;
+        charLengths[rank] = static_cast<uint8_t>(CodecUTF8::EncodeString32ToBytes(&c, 1, &charBytes[MAX_CHAR_LENGTH * rank]));
+    }
+}
+
+template <typename rankType>
+std::vector<rankType> AlphabetMap::GetRanks(const std::u32string_view& str) const
+{
+    std::vector<rankType> ranks(str.size());
+    const uint32_t* indices = pageIndices.data();
+    const uint32_t* pages = pageRanks.data();
+    for (size_t i = 0; i < str.size(); ++i) {
+        char32_t c = str[i];
+        ranks[i] = static_cast<rankType>(pages[(size_t(indices[c >> PAGE_BITS]) << PAGE_BITS) | (c & PAGE_MASK)]);
+    }
+    return ranks;
+}
+
+template <typename Function>
+void AlphabetMap::VisitRanks(const std::u32string_view& str, Function function) const
+{
+    if (alphabet.size() <= 256) {
+        function(GetRanks<uint8_t>(str));
+    } else if (alphabet.size() <= 65536) {
+        function(GetRanks<uint16_t>(str));
+    } else {
+        function(GetRanks<uint32_t>(str));
+    }
+}
+
+// every character is copied as MAX_CHAR_LENGTH bytes, the extra bytes are overwritten by the next character
+template <typename rankType>
+std::string AlphabetMap::GetUTF8String(const rankType* ranks, const size_t& size) const
+{
+    std::string result(MAX_CHAR_LENGTH * size, '\0');
+    char* output = &result[0];
+    size_t length = 0;
+    for (size_t i = 0; i < size; ++i) {
+        std::memcpy(output + length, &charBytes[MAX_CHAR_LENGTH * ranks[i]], MAX_CHAR_LENGTH);
+        length += charLengths[ranks[i]];
+    }
+    result.resize(length);
+    return result;
+}
+
+void AlphabetMap::Write(BinaryWriter& writer) const
+{
+    writer.WriteValue(static_cast<uint32_t>(alphabet.size()));
+    CodecUTF8::EncodeString32ToBinaryFile(writer, alphabet);
+}
+
+AlphabetMap AlphabetMap::Read(BinaryReader& reader)
+{
+    AlphabetMap alphabetMap;
+    uint32_t alphabetLength = reader.ReadValue<uint32_t>();
+    alphabetMap.alphabet = CodecUTF8::DecodeString32FromBinaryFile(reader, alphabetLength);
+    alphabetMap.BuildTables();
+    return alphabetMap;
+}
+
+// END IMPLEMENTATION
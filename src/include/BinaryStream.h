@@ -0,0 +1,302 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+
+#if defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define BINARY_STREAM_BIG_ENDIAN
+#endif
+
+#include "BitStream.h"
+#include "BlockFile.h"
+
+/**
+ * Buffered binary streams in memory or in a binary file (FILE* or BlockFile)
+ * integers are stored in little-endian order whatever the byte order of the processor is.
+ * values are read and written through the buffer (the file is used every BUFFER_SIZE bytes),
+ * reading after the end of the input throws
+*/
+class BinaryWriter {
+public:
+    BinaryWriter() = default;
+    // bytes are written to the file when the buffer is full and on Flush()
+    BinaryWriter(FILE* file) : file(file), buffer(BUFFER_SIZE) {}
+    BinaryWriter(BlockFile* blockFile) : blockFile(blockFile), buffer(BUFFER_SIZE) {}
+
+    // (defined in the class to be inlined into encoding loops)
+    template <typename valueType>
+    void WriteValue(const valueType& value) {
+        if (buffer.size() - length < sizeof(valueType)) {
+            Reserve(sizeof(valueType));
+        }
+        StoreLittleEndian(buffer.data() + length, value);
+        length += sizeof(valueType);
+    }
+    template <typename valueType>
+    void WriteValues(const std::vector<valueType>& values);
+    void WriteBytes(const uint8_t* bytes, const size_t& count);
+    void WriteBytes(const std::vector<uint8_t>& bytes) { WriteBytes(bytes.data(), bytes.size()); }
+    void WriteString(const std::string& str) { WriteBytes(reinterpret_cast<const uint8_t*>(str.data()), str.size()); }
+    // write the buffer to the file (if it's used)
+    void Flush();
+
+    // written bytes (of the memory stream)
+    const uint8_t* GetData() const { return buffer.data(); }
+    size_t GetSize() const { return length; }
+    // forget the written bytes of the memory stream (the buffer is kept for the next ones)
+    void Clear() { length = 0; }
+
+    template <typename valueType>
+    static void StoreLittleEndian(uint8_t* bytes, const valueType& value);
+private:
+    // make place for count bytes: flush the buffer to the file or grow it
+    void Reserve(const size_t& count);
+    bool HasFile() const { return file != nullptr || blockFile != nullptr; }
+    void WriteToFile(const uint8_t* bytes, const size_t& count);
+
+    static constexpr size_t BUFFER_SIZE = 1 << 16;
+
+    FILE* file = nullptr;
+    BlockFile* blockFile = nullptr;
+    std::vector<uint8_t> buffer;
+    size_t length = 0;
+};
+
+class BinaryReader {
+public:
+    BinaryReader(const uint8_t* data, const size_t& size) : data(data), size(size) {}
+    // bytes are read from the file by chunks when they are needed
+    BinaryReader(FILE* file) : data(nullptr), size(0), file(file) {}
+    BinaryReader(BlockFile* blockFile) : data(nullptr), size(0), blockFile(blockFile) {}
+
+    // (defined in the class to be inlined into decoding loops)
+    template <typename valueType>
+    valueType ReadValue() {
+        if (size - pointer < sizeof(valueType) && Fill(sizeof(valueType)) < sizeof(valueType)) {
+            throw std::runtime_error("Unexpected end of binary input");
+        }
+        valueType value = LoadLittleEndian<valueType>(data + pointer);
+        pointer += sizeof(valueType);
+        return value;
+    }
+    template <typename valueType>
+    std::vector<valueType> ReadValues(const size_t& count);
+    void ReadBytes(uint8_t* output, const size_t& count);
+    std::vector<uint8_t> ReadBytes(const size_t& count);
+
+    // make at least count next bytes available (if the input has them), return the number of available bytes
+    size_t Fill(const size_t& count);
+    const uint8_t* GetPointer() const { return data + pointer; }
+    void Skip(const size_t& count);
+    // the rest of the input as a bit stream (the reader can't be used after that, block files aren't supported)
+    BitReader GetBitReader();
+
+    template <typename valueType>
+    static valueType LoadLittleEndian(const uint8_t* bytes);
+private:
+    bool HasFile() const { return file != nullptr || blockFile != nullptr; }
+    size_t ReadFromFile(uint8_t* output, const size_t& count);
+
+    static constexpr size_t BUFFER_SIZE = 1 << 16;
+
+    const uint8_t* data;
+    size_t size;
+    size_t pointer = 0;
+    FILE* file = nullptr;
+    BlockFile* blockFile = nullptr;
+    std::vector<uint8_t> buffer;
+};
+
+
+// START IMPLEMENTATION
+
+// (one copy on little-endian processors, bytes are stored one by one on big-endian ones)
+template <typename valueType>
+void BinaryWriter::StoreLittleEndian(uint8_t* bytes, const valueType& value)
+{
+    static_assert(std::is_integral<valueType>::value, "Only integers can be written");
+#ifdef BINARY_STREAM_BIG_ENDIAN
+    using unsignedType = typename std::make_unsigned<valueType>::type;
+    unsignedType unsignedValue = static_cast<unsignedType>(value);
+    for (size_t i = 0; i < sizeof(valueType); ++i) {
+        bytes[i] = static_cast<uint8_t>(unsignedValue >> (8 * i));
+    }
+#else
+    std::memcpy(bytes, &value, sizeof(valueType));
+#endif
+}
+
+template <typename valueType>
+void BinaryWriter::WriteValues(const std::vector<valueType>& values)
+{
+    if (sizeof(valueType) == 1) {
+        WriteBytes(reinterpret_cast<const uint8_t*>(values.data()), values.size());
+        return;
+    }
+    for (const valueType& value : values) {
+        WriteValue(value);
+    }
+}
+
+void BinaryWriter::WriteBytes(const uint8_t* bytes, const size_t& count)
+{
+    if (buffer.size() - length < count) {
+        Reserve(count);
+    }
+    // big blocks go to the file directly
+    if (HasFile() && count >= BUFFER_SIZE) {
+        WriteToFile(bytes, count);
+        return;
+    }
+    if (count > 0) {
+        std::memcpy(buffer.data() + length, bytes, count);
+        length += count;
+    }
+}
+
+void BinaryWriter::Reserve(const size_t& count)
+{
+    if (HasFile()) {
+        Flush();
+        return;
+    }
+    buffer.resize(std::max(2 * buffer.size(), length + count));
+}
+
+void BinaryWriter::Flush()
+{
+    if (HasFile() && length > 0) {
+        WriteToFile(buffer.data(), length);
+        length = 0;
+    }
+}
+
+void BinaryWriter::WriteToFile(const uint8_t* bytes, const size_t& count)
+{
+    if (blockFile != nullptr) {
+        blockFile->Write(bytes, count);
+    } else if (fwrite(bytes, 1, count, file) != count) {
+        throw std::runtime_error("Failed to write to file");
+    }
+}
+
+// ==========================================================================================================
+
+template <typename valueType>
+valueType BinaryReader::LoadLittleEndian(const uint8_t* bytes)
+{
+    static_assert(std::is_integral<valueType>::value, "Only integers can be read");
+#ifdef BINARY_STREAM_BIG_ENDIAN
+    using unsignedType = typename std::make_unsigned<valueType>::type;
+    unsignedType value = 0;
+    for (size_t i = 0; i < sizeof(valueType); ++i) {
+        value |= static_cast<unsignedType>(static_cast<unsignedType>(bytes[i]) << (8 * i));
+    }
+    return static_cast<valueType>(value);
+#else
+    valueType value;
+    std::memcpy(&value, bytes, sizeof(valueType));
+    return value;
+#endif
+}
+
+template <typename valueType>
+std::vector<valueType> BinaryReader::ReadValues(const size_t& count)
+{
+    std::vector<valueType> values(count);
+    if (sizeof(valueType) == 1) {
+        ReadBytes(reinterpret_cast<uint8_t*>(values.data()), count);
+        return values;
+    }
+    for (valueType& value : values) {
+        value = ReadValue<valueType>();
+    }
+    return values;
+}
+
+void BinaryReader::ReadBytes(uint8_t* output, const size_t& count)
+{
+    size_t buffered = std::min(count, size - pointer);
+    if (buffered > 0) {
+        std::memcpy(output, data + pointer, buffered);
+        pointer += buffered;
+    }
+    // the rest of big blocks is read from the file directly
+    if (buffered < count) {
+        size_t rest = count - buffered;
+        bool isRead = HasFile() && ((rest >= BUFFER_SIZE) ? ReadFromFile(output + buffered, rest) == rest : Fill(rest) >= rest);
+        if (!isRead) {
+            throw std::runtime_error("Unexpected end of binary input");
+        }
+        if (rest < BUFFER_SIZE) {
+            std::memcpy(output + buffered, data + pointer, rest);
+            pointer += rest;
+        }
+    }
+}
+
+// a wrong count from a damaged memory input throws before the allocation
+std::vector<uint8_t> BinaryReader::ReadBytes(const size_t& count)
+{
+    if (!HasFile() && count > size - pointer) {
+        throw std::runtime_error("Unexpected end of binary input");
+    }
+    std::vector<uint8_t> bytes(count);
+    ReadBytes(bytes.data(), count);
+    return bytes;
+}
+
+// the rest bytes are moved to the beginning of the buffer and the file fills it after them
+size_t BinaryReader::Fill(const size_t& count)
+{
+    if (size - pointer >= count || !HasFile()) {
+        return size - pointer;
+    }
+    size_t rest = size - pointer;
+    if (buffer.size() < std::max(count, BUFFER_SIZE)) {
+        std::vector<uint8_t> newBuffer(std::max(count, BUFFER_SIZE));
+        if (rest > 0) {
+            std::memcpy(newBuffer.data(), data + pointer, rest);
+        }
+        buffer.swap(newBuffer);
+    } else if (rest > 0) {
+        std::memmove(buffer.data(), data + pointer, rest);
+    }
+    data = buffer.data();
+    size = rest + ReadFromFile(buffer.data() + rest, buffer.size() - rest);
+    pointer = 0;
+    return size;
+}
+
+void BinaryReader::Skip(const size_t& count)
+{
+    if (Fill(count) < count) {
+        throw std::runtime_error("Unexpected end of binary input");
+    }
+    pointer += count;
+}
+
+size_t BinaryReader::ReadFromFile(uint8_t* output, const size_t& count)
+{
+    return (blockFile != nullptr) ? blockFile->Read(output, count) : fread(output, 1, count, file);
+}
+
+BitReader BinaryReader::GetBitReader()
+{
+    if (blockFile != nullptr) {
+        throw std::runtime_error("Block files can't be read by bits");
+    }
+    BitReader reader(data + pointer, size - pointer, file);
+    pointer = size;
+    file = nullptr;
+    return reader;
+}
+
+// END IMPLEMENTATION
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+
+/**
+ * Bit streams in memory or in a binary file
+ * bits are written and read starting from the most significant bit of every byte,
+ * so canonical Huffman codes can be compared as numbers while decoding
+*/
+class BitWriter {
+public:
+    BitWriter() = default;
+    // bytes are written to the file every FILE_CHUNK_SIZE bytes and on Flush()
+    BitWriter(FILE* file) : file(file) {}
+
+    // write the lowest count bits of value (count <= 32)
+    void WriteBits(const uint32_t& value, const uint8_t& count);
+    void WriteBit(const bool& bit);
+    // write the rest bits of the last byte (filled with zeros)
+    // and the rest bytes to the file (if it's used)
+    void Flush();
+
+    uint64_t GetBitsCount() const { return bitsCount; }
+    const std::vector<uint8_t>& GetBytes() const { return bytes; }
+    std::vector<uint8_t>& GetBytes() { return bytes; }
+private:
+    static constexpr size_t FILE_CHUNK_SIZE = 1 << 16;
+
+    std::vector<uint8_t> bytes;
+    FILE* file = nullptr;
+    uint64_t buffer = 0;
+    uint8_t bufferLength = 0;
+    uint64_t bitsCount = 0;
+};
+
+class BitReader {
+public:
+    BitReader(const uint8_t* data, const size_t& size) : data(data), size(size) {}
+    // bytes are read from the file by chunks when they are needed
+    BitReader(FILE* file) : data(nullptr), size(0), file(file) {}
+    // bytes in the memory are followed by the rest of the file
+    BitReader(const uint8_t* data, const size_t& size, FILE* file) : data(data), size(size), file(file) {}
+
+    // read count bits (count <= 32), bits after the end of data are zeros
+    uint32_t ReadBits(const uint8_t& count);
+    bool ReadBit();
+    // look at the next count bits (1 <= count <= 32) without moving
+    // (defined in the class to be inlined into decoding loops)
+    uint32_t PeekBits(const uint8_t& count) {
+        if (bufferLength < count) {
+            Refill();
+        }
+        return static_cast<uint32_t>(buffer >> (64 - count));
+    }
+    void SkipBits(const uint8_t& count) {
+        if (bufferLength < count) {
+            Refill();
+        }
+        buffer <<= count;
+        bufferLength -= count;
+    }
+    // true if zeros after the end of data were read (bytes after the end are counted by the pointer)
+    bool IsPastEnd() const { return pointer > size && 8 * (pointer - size) > bufferLength; }
+private:
+    void Refill();
+    bool ReadFileChunk();
+
+    static constexpr size_t FILE_CHUNK_SIZE = 1 << 16;
+
+    const uint8_t* data;
+    size_t size;
+    size_t pointer = 0;
+    FILE* file = nullptr;
+    std::vector<uint8_t> fileBuffer;
+    uint64_t buffer = 0; // the next bit is the most significant one
+    uint8_t bufferLength = 0;
+};
+
+
+// START IMPLEMENTATION
+
+void BitWriter::WriteBits(const uint32_t& value, const uint8_t& count)
+{
+    if (count == 0) {
+        return;
+    }
+    buffer = (buffer << count) | (value & (0xFFFFFFFFu >> (32 - count)));
+    bufferLength += count;
+    bitsCount += count;
+    while (bufferLength >= 8) {
+        bufferLength -= 8;
+        bytes.push_back(static_cast<uint8_t>(buffer >> bufferLength));
+    }
+    if (file != nullptr && bytes.size() >= FILE_CHUNK_SIZE) {
+        fwrite(bytes.data(), 1, bytes.size(), file);
+        bytes.clear();
+    }
+}
+
+void BitWriter::WriteBit(const bool& bit)
+{
+    WriteBits(bit ? 1 : 0, 1);
+}
+
+void BitWriter::Flush()
+{
+    if (bufferLength > 0) {
+        bytes.push_back(static_cast<uint8_t>(buffer << (8 - bufferLength)));
+        bitsCount += 8 - bufferLength;
+        bufferLength = 0;
+    }
+    buffer = 0;
+    if (file != nullptr && !bytes.empty()) {
+        fwrite(bytes.data(), 1, bytes.size(), file);
+        bytes.clear();
+    }
+}
+
+// ==========================================================================================================
+
+void BitReader::Refill()
+{
+    if (pointer + 8 <= size) {
+        // read 8 bytes at once, bits which don't fit will be read again by the next refill
+        uint64_t word = 0;
+        for (int i = 0; i < 8; ++i) {
+            word = (word << 8) | data[pointer + i];
+        }
+        buffer |= word >> bufferLength;
+        uint8_t bytesCount = (64 - bufferLength) >> 3;
+        pointer += bytesCount;
+        bufferLength += bytesCount * 8;
+        return;
+    }
+    while (bufferLength <= 56) {
+        if (pointer >= size && file != nullptr && !ReadFileChunk()) {
+            file = nullptr;
+        }
+        uint64_t byte = (pointer < size) ? data[pointer] : 0;
+        ++pointer;
+        buffer |= byte << (56 - bufferLength);
+        bufferLength += 8;
+    }
+}
+
+// replace consumed data with the next chunk of the file
+bool BitReader::ReadFileChunk()
+{
+    fileBuffer.resize(FILE_CHUNK_SIZE);
+    size_t bytesRead = fread(fileBuffer.data(), 1, FILE_CHUNK_SIZE, file);
+    data = fileBuffer.data();
+    size = bytesRead;
+    pointer = 0;
+    return bytesRead > 0;
+}
+
+uint32_t BitReader::ReadBits(const uint8_t& count)
+{
+    if (count == 0) {
+        return 0;
+    }
+    uint32_t value = PeekBits(count);
+    SkipBits(count);
+    return value;
+}
+
+bool BitReader::ReadBit()
+{
+    return ReadBits(1) != 0;
+}
+
+// END IMPLEMENTATION
@@ -0,0 +1,635 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#define BLOCK_FILE_POSIX
+#endif
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter) && defined(__NR_io_uring_register)
+#define BLOCK_FILE_IO_URING
+#endif
+#endif
+#endif
+
+/**
+ * Binary file which is read or written in order by big blocks
+ * PREAD_PWRITE - every call is one pread or pwrite at the current offset (fread or fwrite without POSIX),
+ * IO_URING - BUFFERS_COUNT registered buffers of BUFFER_SIZE bytes are in flight at once: the next blocks
+ * are read ahead of the reader and the written blocks are saved behind the writer.
+ * operations are submitted by batches and completions are polled from the ring without syscalls.
+ * if io_uring isn't supported by the kernel, the file falls back to PREAD_PWRITE
+*/
+class BlockFile
+{
+public:
+    enum Backend : uint8_t { PREAD_PWRITE = 0, IO_URING = 1 };
+
+    static BlockFile OpenRead(const char* filepath, const Backend& backend = PREAD_PWRITE);
+    static BlockFile OpenWrite(const char* filepath, const Backend& backend = PREAD_PWRITE);
+
+    BlockFile(const BlockFile&) = delete;
+    BlockFile& operator=(const BlockFile&) = delete;
+    BlockFile(BlockFile&& other) noexcept;
+    ~BlockFile();
+
+    // backend which is used (after the fallback)
+    Backend GetBackend() const { return backend; }
+
+    // read at most size next bytes, return the number of read bytes (less than size only at the end of the file)
+    size_t Read(uint8_t* output, const size_t& size);
+    void Write(const uint8_t* data, const size_t& size);
+    // wait until all the written bytes are in the file
+    void Flush();
+    // flush and close the file
+    void Close();
+protected:
+    static constexpr size_t BUFFER_SIZE = 1 << 18;
+    static constexpr size_t BUFFERS_COUNT = 8;
+    // prepared operations are submitted by one syscall when there are this many of them or when a block is waited for
+    static constexpr size_t SUBMIT_BATCH_SIZE = 4;
+
+    BlockFile() = default;
+
+    // bytes at the position (the file is read or written in order without POSIX)
+    size_t ReadAt(uint8_t* output, const size_t& size, const uint64_t& position);
+    void WriteAt(const uint8_t* data, const size_t& size, const uint64_t& position);
+
+    Backend backend = PREAD_PWRITE;
+    bool isWritable = false;
+    uint64_t offset = 0; // of the next read or written block
+#ifdef BLOCK_FILE_POSIX
+    int fileDescriptor = -1;
+    uint64_t fileSize = 0;
+#else
+    FILE* file = nullptr;
+#endif
+
+#ifdef BLOCK_FILE_IO_URING
+    // submission and completion rings of io_uring (without liburing)
+    class Ring
+    {
+    public:
+        // throw if io_uring can't be created
+        explicit Ring(const uint32_t& entries);
+        Ring(const Ring&) = delete;
+        Ring& operator=(const Ring&) = delete;
+        ~Ring();
+
+        // return false if the buffers can't be registered (the memory lock limit is too low)
+        bool RegisterBuffers(const std::vector<iovec>& buffers);
+        // the operation isn't submitted until Submit
+        void Prepare(const uint8_t& opcode, const int& fileDescriptor, const iovec& buffer, const iovec* vector,
+                     const uint16_t& bufferIndex, const uint64_t& offset, const uint64_t& userData);
+        size_t GetPreparedCount() const { return preparedCount; }
+        // submit the prepared operations and wait for at least waitCount completions
+        void Submit(const uint32_t& waitCount);
+        // take the next completion if there is one (without syscalls)
+        bool PollCompletion(uint64_t& userData, int32_t& result);
+    private:
+        int ringDescriptor = -1;
+        uint8_t* submissionRing = nullptr;
+        uint8_t* completionRing = nullptr;
+        size_t submissionRingSize = 0;
+        size_t completionRingSize = 0;
+        io_uring_sqe* submissionEntries = nullptr;
+        size_t submissionEntriesSize = 0;
+        uint32_t entriesCount = 0;
+        uint32_t* submissionHead = nullptr;
+        uint32_t* submissionTail = nullptr;
+        uint32_t* submissionMask = nullptr;
+        uint32_t* submissionArray = nullptr;
+        uint32_t* completionHead = nullptr;
+        uint32_t* completionTail = nullptr;
+        uint32_t* completionMask = nullptr;
+        io_uring_cqe* completionEntries = nullptr;
+        size_t preparedCount = 0;
+    };
+
+    struct block {
+        std::vector<uint8_t> bytes;
+        uint64_t offset = 0;
+        size_t length = 0; // read bytes or bytes to write
+        size_t pointer = 0; // next byte to read
+        bool isInFlight = false;
+    };
+
+    // try to create the ring and its buffers, return false if io_uring isn't supported
+    bool StartRing();
+    // wait for all the operations in flight and destroy the ring (errors are ignored)
+    void StopRing();
+    void SubmitBlock(const size_t& index);
+    void CompleteBlock(const size_t& index, const int32_t& result);
+    void WaitBlock(const size_t& index);
+
+    std::unique_ptr<Ring> ring;
+    std::vector<block> blocks;
+    std::vector<iovec> buffers;
+    bool isRegistered = false;
+    size_t currentBlock = 0;
+#endif
+};
+
+
+// START IMPLEMENTATION
+
+
+#ifdef BLOCK_FILE_POSIX
+
+BlockFile BlockFile::OpenRead(const char* filepath, const Backend& backend)
+{
+    BlockFile blockFile;
+    blockFile.fileDescriptor = open(filepath, O_RDONLY);
+    struct stat fileStat;
+    if (blockFile.fileDescriptor < 0 || fstat(blockFile.fileDescriptor, &fileStat) != 0) {
+        throw std::runtime_error("Failed to open file " + std::string(filepath));
+    }
+    blockFile.fileSize = static_cast<uint64_t>(fileStat.st_size);
+#ifdef BLOCK_FILE_IO_URING
+    if (backend == IO_URING && blockFile.StartRing()) {
+        // all the buffers are filled at once
+        for (size_t i = 0; i < BUFFERS_COUNT; ++i) {
+            blockFile.SubmitBlock(i);
+        }
+        blockFile.ring->Submit(0);
+    }
+#else
+    (void)backend;
+#endif
+    return blockFile;
+}
+
+BlockFile BlockFile::OpenWrite(const char* filepath, const Backend& backend)
+{
+    BlockFile blockFile;
+    blockFile.isWritable = true;
+    blockFile.fileDescriptor = open(filepath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (blockFile.fileDescriptor < 0) {
+        throw std::runtime_error("Failed to open file " + std::string(filepath));
+    }
+#ifdef BLOCK_FILE_IO_URING
+    if (backend == IO_URING) {
+        blockFile.StartRing();
+    }
+#else
+    (void)backend;
+#endif
+    return blockFile;
+}
+
+BlockFile::BlockFile(BlockFile&& other) noexcept :
+    backend(other.backend), isWritable(other.isWritable), offset(other.offset),
+    fileDescriptor(std::exchange(other.fileDescriptor, -1)), fileSize(other.fileSize)
+#ifdef BLOCK_FILE_IO_URING
+    , ring(std::move(other.ring)), blocks(std::move(other.blocks)), buffers(std::move(other.buffers)),
+    isRegistered(other.isRegistered), currentBlock(other.currentBlock)
+#endif
+{
+}
+
+size_t BlockFile::ReadAt(uint8_t* output, const size_t& size, const uint64_t& position)
+{
+    size_t count = 0;
+    while (count < size) {
+        ssize_t result = pread(fileDescriptor, output + count, size - count, static_cast<off_t>(position + count));
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result < 0) {
+            throw std::runtime_error("Failed to read file");
+        }
+        if (result == 0) {
+            break;
+        }
+        count += static_cast<size_t>(result);
+    }
+    return count;
+}
+
+void BlockFile::WriteAt(const uint8_t* data, const size_t& size, const uint64_t& position)
+{
+    size_t count = 0;
+    while (count < size) {
+        ssize_t result = pwrite(fileDescriptor, data + count, size - count, static_cast<off_t>(position + count));
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            throw std::runtime_error("Failed to write to file");
+        }
+        count += static_cast<size_t>(result);
+    }
+}
+
+void BlockFile::Close()
+{
+    if (fileDescriptor < 0) {
+        return;
+    }
+    std::exception_ptr exception;
+    try {
+        Flush();
+    } catch (...) {
+        exception = std::current_exception();
+    }
+#ifdef BLOCK_FILE_IO_URING
+    StopRing();
+#endif
+    close(fileDescriptor);
+    fileDescriptor = -1;
+    if (exception) {
+        std::rethrow_exception(exception);
+    }
+}
+
+#else
+
+BlockFile BlockFile::OpenRead(const char* filepath, const Backend&)
+{
+    BlockFile blockFile;
+    blockFile.file = fopen(filepath, "rb");
+    if (blockFile.file == nullptr) {
+        throw std::runtime_error("Failed to open file " + std::string(filepath));
+    }
+    return blockFile;
+}
+
+BlockFile BlockFile::OpenWrite(const char* filepath, const Backend&)
+{
+    BlockFile blockFile;
+    blockFile.isWritable = true;
+    blockFile.file = fopen(filepath, "wb");
+    if (blockFile.file == nullptr) {
+        throw std::runtime_error("Failed to open file " + std::string(filepath));
+    }
+    return blockFile;
+}
+
+BlockFile::BlockFile(BlockFile&& other) noexcept :
+    backend(other.backend), isWritable(other.isWritable), offset(other.offset), file(std::exchange(other.file, nullptr))
+{
+}
+
+// the offset is always the position of the file
+size_t BlockFile::ReadAt(uint8_t* output, const size_t& size, const uint64_t&)
+{
+    size_t count = fread(output, 1, size, file);
+    if (count < size && ferror(file)) {
+        throw std::runtime_error("Failed to read file");
+    }
+    return count;
+}
+
+void BlockFile::WriteAt(const uint8_t* data, const size_t& size, const uint64_t&)
+{
+    if (fwrite(data, 1, size, file) != size) {
+        throw std::runtime_error("Failed to write to file");
+    }
+}
+
+void BlockFile::Close()
+{
+    if (file != nullptr) {
+        fclose(file);
+        file = nullptr;
+    }
+}
+
+#endif
+
+size_t BlockFile::Read(uint8_t* output, const size_t& size)
+{
+#ifdef BLOCK_FILE_IO_URING
+    if (ring) {
+        size_t count = 0;
+        while (count < size) {
+            block& current = blocks[currentBlock];
+            WaitBlock(currentBlock);
+            if (current.pointer == current.length) {
+                // the block wasn't submitted after the end of the file
+                break;
+            }
+            size_t length = std::min(size - count, current.length - current.pointer);
+            std::memcpy(output + count, current.bytes.data() + current.pointer, length);
+            current.pointer += length;
+            count += length;
+            if (current.pointer == current.length) {
+                SubmitBlock(currentBlock);
+                currentBlock = (currentBlock + 1) % BUFFERS_COUNT;
+            }
+        }
+        return count;
+    }
+#endif
+    size_t count = ReadAt(output, size, offset);
+    offset += count;
+    return count;
+}
+
+void BlockFile::Write(const uint8_t* data, const size_t& size)
+{
+#ifdef BLOCK_FILE_IO_URING
+    if (ring) {
+        size_t count = 0;
+        while (count < size) {
+            block& current = blocks[currentBlock];
+            WaitBlock(currentBlock);
+            size_t length = std::min(size - count, BUFFER_SIZE - current.length);
+            std::memcpy(current.bytes.data() + current.length, data + count, length);
+            current.length += length;
+            count += length;
+            if (current.length == BUFFER_SIZE) {
+                SubmitBlock(currentBlock);
+                currentBlock = (currentBlock + 1) % BUFFERS_COUNT;
+            }
+        }
+        return;
+    }
+#endif
+    WriteAt(data, size, offset);
+    offset += size;
+}
+
+void BlockFile::Flush()
+{
+#ifdef BLOCK_FILE_IO_URING
+    if (ring && isWritable) {
+        if (!blocks[currentBlock].isInFlight && blocks[currentBlock].length > 0) {
+            SubmitBlock(currentBlock);
+            currentBlock = (currentBlock + 1) % BUFFERS_COUNT;
+        }
+        for (size_t i = 0; i < BUFFERS_COUNT; ++i) {
+            WaitBlock(i);
+        }
+    }
+#endif
+}
+
+// errors of closing are lost here, Close can be called before to get them
+BlockFile::~BlockFile()
+{
+    try {
+        Close();
+    } catch (...) {
+    }
+}
+
+#ifdef BLOCK_FILE_IO_URING
+
+BlockFile::Ring::Ring(const uint32_t& entries)
+{
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    ringDescriptor = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    if (ringDescriptor < 0) {
+        throw std::runtime_error("io_uring isn't supported");
+    }
+    entriesCount = params.sq_entries;
+
+    // old kernels map the submission and completion rings separately
+    submissionRingSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    completionRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool isSingleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (isSingleMap) {
+        submissionRingSize = completionRingSize = std::max(submissionRingSize, completionRingSize);
+    }
+    void* address = mmap(nullptr, submissionRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringDescriptor, IORING_OFF_SQ_RING);
+    if (address == MAP_FAILED) {
+        close(ringDescriptor);
+        throw std::runtime_error("Failed to map io_uring");
+    }
+    submissionRing = static_cast<uint8_t*>(address);
+    if (isSingleMap) {
+        completionRing = submissionRing;
+    } else {
+        address = mmap(nullptr, completionRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringDescriptor, IORING_OFF_CQ_RING);
+        if (address == MAP_FAILED) {
+            munmap(submissionRing, submissionRingSize);
+            close(ringDescriptor);
+            throw std::runtime_error("Failed to map io_uring");
+        }
+        completionRing = static_cast<uint8_t*>(address);
+    }
+    submissionEntriesSize = params.sq_entries * sizeof(io_uring_sqe);
+    address = mmap(nullptr, submissionEntriesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringDescriptor, IORING_OFF_SQES);
+    if (address == MAP_FAILED) {
+        if (!isSingleMap) {
+            munmap(completionRing, completionRingSize);
+        }
+        munmap(submissionRing, submissionRingSize);
+        close(ringDescriptor);
+        throw std::runtime_error("Failed to map io_uring");
+    }
+    submissionEntries = static_cast<io_uring_sqe*>(address);
+
+    submissionHead = reinterpret_cast<uint32_t*>(submissionRing + params.sq_off.head);
+    submissionTail = reinterpret_cast<uint32_t*>(submissionRing + params.sq_off.tail);
+    submissionMask = reinterpret_cast<uint32_t*>(submissionRing + params.sq_off.ring_mask);
+    submissionArray = reinterpret_cast<uint32_t*>(submissionRing + params.sq_off.array);
+    completionHead = reinterpret_cast<uint32_t*>(completionRing + params.cq_off.head);
+    completionTail = reinterpret_cast<uint32_t*>(completionRing + params.cq_off.tail);
+    completionMask = reinterpret_cast<uint32_t*>(completionRing + params.cq_off.ring_mask);
+    completionEntries = reinterpret_cast<io_uring_cqe*>(completionRing + params.cq_off.cqes);
+}
+
+BlockFile::Ring::~Ring()
+{
+    munmap(submissionEntries, submissionEntriesSize);
+    if (completionRing != submissionRing) {
+        munmap(completionRing, completionRingSize);
+    }
+    munmap(submissionRing, submissionRingSize);
+    close(ringDescriptor);
+}
+
+bool BlockFile::Ring::RegisterBuffers(const std::vector<iovec>& buffers)
+{
+    return syscall(__NR_io_uring_register, ringDescriptor, IORING_REGISTER_BUFFERS, buffers.data(), static_cast<unsigned>(buffers.size())) == 0;
+}
+
+// the kernel reads the tail after the entry is filled, so the tail is stored with release
+void BlockFile::Ring::Prepare(const uint8_t& opcode, const int& fileDescriptor, const iovec& buffer, const iovec* vector,
+                              const uint16_t& bufferIndex, const uint64_t& offset, const uint64_t& userData)
+{
+    uint32_t tail = *submissionTail;
+    if (tail - __atomic_load_n(submissionHead, __ATOMIC_ACQUIRE) >= entriesCount) {
+        Submit(0);
+    }
+    uint32_t index = tail & *submissionMask;
+    io_uring_sqe& entry = submissionEntries[index];
+    std::memset(&entry, 0, sizeof(entry));
+    entry.opcode = opcode;
+    entry.fd = fileDescriptor;
+    entry.off = offset;
+    // vectored operations take the array of buffers instead of the buffer
+    entry.addr = reinterpret_cast<uint64_t>((vector != nullptr) ? static_cast<const void*>(vector) : buffer.iov_base);
+    entry.len = (vector != nullptr) ? 1 : static_cast<uint32_t>(buffer.iov_len);
+    entry.buf_index = bufferIndex;
+    entry.user_data = userData;
+    submissionArray[index] = index;
+    __atomic_store_n(submissionTail, tail + 1, __ATOMIC_RELEASE);
+    ++preparedCount;
+}
+
+void BlockFile::Ring::Submit(const uint32_t& waitCount)
+{
+    while (preparedCount > 0 || waitCount > 0) {
+        long result = syscall(__NR_io_uring_enter, ringDescriptor, static_cast<unsigned>(preparedCount), waitCount,
+                              (waitCount > 0) ? IORING_ENTER_GETEVENTS : 0u, nullptr, 0);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result < 0) {
+            throw std::runtime_error("Failed to submit to io_uring");
+        }
+        preparedCount -= std::min<size_t>(preparedCount, static_cast<size_t>(result));
+        return;
+    }
+}
+
+// the kernel writes the entry before the tail, so the tail is loaded with acquire
+bool BlockFile::Ring::PollCompletion(uint64_t& userData, int32_t& result)
+{
+    uint32_t head = *completionHead;
+    if (head == __atomic_load_n(completionTail, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+    const io_uring_cqe& entry = completionEntries[head & *completionMask];
+    userData = entry.user_data;
+    result = entry.res;
+    __atomic_store_n(completionHead, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+// ==========================================================================================================
+
+bool BlockFile::StartRing()
+{
+    try {
+        ring.reset(new Ring(BUFFERS_COUNT));
+    } catch (const std::runtime_error&) {
+        return false;
+    }
+    blocks.resize(BUFFERS_COUNT);
+    buffers.resize(BUFFERS_COUNT);
+    for (size_t i = 0; i < BUFFERS_COUNT; ++i) {
+        blocks[i].bytes.resize(BUFFER_SIZE);
+        buffers[i].iov_base = blocks[i].bytes.data();
+        buffers[i].iov_len = BUFFER_SIZE;
+    }
+    isRegistered = ring->RegisterBuffers(buffers);
+    backend = IO_URING;
+    return true;
+}
+
+void BlockFile::StopRing()
+{
+    if (!ring) {
+        return;
+    }
+    // the kernel mustn't write to the buffers after they are freed
+    try {
+        for (size_t i = 0; i < BUFFERS_COUNT; ++i) {
+            while (blocks[i].isInFlight) {
+                uint64_t userData;
+                int32_t result;
+                if (!ring->PollCompletion(userData, result)) {
+                    ring->Submit(1);
+                } else if (userData < BUFFERS_COUNT) {
+                    blocks[userData].isInFlight = false;
+                }
+            }
+        }
+    } catch (...) {
+    }
+    ring.reset();
+    blocks.clear();
+    buffers.clear();
+}
+
+// reading: the next block of the file goes to the consumed buffer (nothing is read after the end of the file),
+// writing: the filled buffer goes to the end of the written bytes
+void BlockFile::SubmitBlock(const size_t& index)
+{
+    block& current = blocks[index];
+    current.pointer = 0;
+    current.offset = offset;
+    if (!isWritable) {
+        current.length = static_cast<size_t>(std::min<uint64_t>(BUFFER_SIZE, fileSize - std::min(fileSize, offset)));
+        if (current.length == 0) {
+            return;
+        }
+    }
+    offset += current.length;
+
+    uint8_t opcode = isWritable ? (isRegistered ? IORING_OP_WRITE_FIXED : IORING_OP_WRITEV) :
+                                  (isRegistered ? IORING_OP_READ_FIXED : IORING_OP_READV);
+    iovec buffer = buffers[index];
+    buffer.iov_len = current.length;
+    buffers[index].iov_len = current.length;
+    ring->Prepare(opcode, fileDescriptor, buffer, isRegistered ? nullptr : &buffers[index],
+                  static_cast<uint16_t>(index), current.offset, index);
+    current.isInFlight = true;
+    if (ring->GetPreparedCount() >= SUBMIT_BATCH_SIZE) {
+        ring->Submit(0);
+    }
+}
+
+// short reads and writes are finished synchronously
+void BlockFile::CompleteBlock(const size_t& index, const int32_t& result)
+{
+    block& current = blocks[index];
+    current.isInFlight = false;
+    if (result < 0) {
+        throw std::runtime_error(isWritable ? "Failed to write to file" : "Failed to read file");
+    }
+    size_t done = static_cast<size_t>(result);
+    if (isWritable) {
+        if (done < current.length) {
+            WriteAt(current.bytes.data() + done, current.length - done, current.offset + done);
+        }
+        current.length = 0;
+    } else if (done < current.length) {
+        current.length = done + ReadAt(current.bytes.data() + done, current.length - done, current.offset + done);
+    }
+}
+
+// completions come in any order, the prepared operations are submitted with the wait
+void BlockFile::WaitBlock(const size_t& index)
+{
+    while (blocks[index].isInFlight) {
+        uint64_t userData;
+        int32_t result;
+        if (!ring->PollCompletion(userData, result)) {
+            ring->Submit(1);
+            continue;
+        }
+        if (userData >= BUFFERS_COUNT) {
+            throw std::runtime_error("Wrong io_uring completion");
+        }
+        CompleteBlock(static_cast<size_t>(userData), result);
+    }
+}
+
+#endif
+
+// END IMPLEMENTATION
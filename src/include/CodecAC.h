@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <cstdint>
 #include <vector>
 #include <queue>
@@ -8,6 +9,7 @@
 #include <cmath> // for std::trunc
 
 #include "FileUtils.h"
+#include "BinaryStream.h"
 #include "CodecUTF8.h"
 #include "TextTools.h"
 
@@ -18,6 +20,10 @@ private:
 public:
     static void Encode(const char* inputPath, const char* outputPath);
     static void Decode(const char* inputPath, const char* outputPath);
+
+    // stage of CodecPipeline: symbols are encoded to the writer
+    static void EncodeSymbols(const std::u32string_view& input, BinaryWriter& writer);
+    static void DecodeSymbols(BinaryReader& reader, std::u32string& output);
 protected:
     struct data_local {
         uint8_t alphabetLength;
@@ -33,8 +39,8 @@ protected:
     };
 
     static data_local Getdata_local(const std::u32string& inputStr);
-    static data GetData(const std::u32string& inputStr);
-    static std::string DecodeAC(FILE* inputFile);
+    static data GetData(const std::u32string_view& inputStr);
+    static std::string DecodeAC(BinaryReader& reader);
 };
 
 
@@ -102,7 +108,7 @@ CodecAC::data_local CodecAC::Getdata_local(const std::u32string& inputStr)
     return data_local(alphabetLocal.size(), alphabetLocal, frequencies, resultValue);
 }
 
-CodecAC::data CodecAC::GetData(const std::u32string& inputStr)
+CodecAC::data CodecAC::GetData(const std::u32string_view& inputStr)
 {
     // maximum number of character in the string to make encoding 
     const uint8_t numChars = 14;
@@ -115,29 +121,29 @@ CodecAC::data CodecAC::GetData(const std::u32string& inputStr)
     // encode every <numChars> characters
     uint64_t CountOfSeq = 0;
     while (CountOfSeq < numberOfFullSequences) {
-        queueLocalData.push(Getdata_local(inputStr.substr(CountOfSeq * numChars, numChars)));
+        queueLocalData.push(Getdata_local(std::u32string(inputStr.substr(CountOfSeq * numChars, numChars))));
         ++CountOfSeq;
     }
     // handle the rest of the string
     if (strLength % numChars != 0) {
-        queueLocalData.push(Getdata_local(inputStr.substr(numberOfFullSequences * numChars, strLength % numChars)));
+        queueLocalData.push(Getdata_local(std::u32string(inputStr.substr(numberOfFullSequences * numChars, strLength % numChars))));
     }
 
     return data(strLength, queueLocalData);
 }
 
-std::string CodecAC::DecodeAC(FILE* inputFile)
+void CodecAC::DecodeSymbols(BinaryReader& reader, std::u32string& output)
 {
     // maximum number of character in the string to make local encoding 
     const uint8_t numChars = 14;
 
-    uint64_t strLength = FileUtils::ReadValueBinary<uint64_t>(inputFile);
+    uint64_t strLength = reader.ReadValue<uint64_t>();
     // number of sequences to encode
     uint64_t numberOfFullSequences = (strLength % numChars == 0) ? (strLength / numChars) : (strLength / numChars);
 
     // counter of decoded sequences
     uint64_t seqsCounter = 0;
-    std::string result;
+    output.clear();
 
     uint8_t alphabetLength;
     std::u32string alphabet;
@@ -145,14 +151,14 @@ std::string CodecAC::DecodeAC(FILE* inputFile)
     long double resultValue;
     while (seqsCounter < numberOfFullSequences) {
         // read values
-        alphabetLength = FileUtils::ReadValueBinary<uint8_t>(inputFile);
-        alphabet = CodecUTF8::DecodeString32FromBinaryFile(inputFile, alphabetLength);
+        alphabetLength = reader.ReadValue<uint8_t>();
+        alphabet = CodecUTF8::DecodeString32FromBinaryFile(reader, alphabetLength);
         std::vector<double> frequencies; frequencies.reserve(alphabetLength);
         for (uint8_t i = 0; i < alphabetLength; ++i) {
-            frequencies.push_back(static_cast<double>(FileUtils::ReadValueBinary<uint8_t>(inputFile)) / 100.0);
+            frequencies.push_back(static_cast<double>(reader.ReadValue<uint8_t>()) / 100.0);
         }
 
-        resultValue = static_cast<long double>(FileUtils::ReadValueBinary<uint64_t>(inputFile)) / static_cast<long double>(1e17);
+        resultValue = static_cast<long double>(reader.ReadValue<uint64_t>()) / static_cast<long double>(1e17);
 
         // decoding
         // inicialize segments
@@ -182,7 +188,7 @@ std::string CodecAC::DecodeAC(FILE* inputFile)
             leftBound = leftBound + segments[index] * distance;
         }
 
-        result += CodecUTF8::EncodeString32ToString(result_local);
+        output += result_local;
         result_local.clear();
         ++seqsCounter;
     }
@@ -190,13 +196,13 @@ std::string CodecAC::DecodeAC(FILE* inputFile)
     // (same code but with different count of iterations in while loop)
     if (strLength % numChars != 0) {
         // read values
-        alphabetLength = FileUtils::ReadValueBinary<uint8_t>(inputFile);
-        alphabet = CodecUTF8::DecodeString32FromBinaryFile(inputFile, alphabetLength);
+        alphabetLength = reader.ReadValue<uint8_t>();
+        alphabet = CodecUTF8::DecodeString32FromBinaryFile(reader, alphabetLength);
         std::vector<double> frequencies; frequencies.reserve(alphabetLength);
         for (uint8_t i = 0; i < alphabetLength; ++i) {
-            frequencies.push_back(static_cast<double>(FileUtils::ReadValueBinary<uint8_t>(inputFile)) / 100.0);
+            frequencies.push_back(static_cast<double>(reader.ReadValue<uint8_t>()) / 100.0);
         }
-        resultValue = static_cast<long double>(FileUtils::ReadValueBinary<uint64_t>(inputFile)) / static_cast<long double>(1e17);
+        resultValue = static_cast<long double>(reader.ReadValue<uint64_t>()) / static_cast<long double>(1e17);
 
         // decoding
         // inicialize segments
@@ -226,41 +232,54 @@ std::string CodecAC::DecodeAC(FILE* inputFile)
             leftBound = leftBound + segments[index] * distance;
         }
 
-        result += CodecUTF8::EncodeString32ToString(result_local);
+        output += result_local;
         ++seqsCounter;
     }
-
-    return result;
 }
 
-void CodecAC::Encode(const char* inputPath, const char* outputPath)
+std::string CodecAC::DecodeAC(BinaryReader& reader)
 {
-    FILE* outputFile = FileUtils::OpenFileBinaryWrite(outputPath);
+    std::u32string result;
+    DecodeSymbols(reader, result);
+    return CodecUTF8::EncodeString32ToString(result);
+}
 
-    data encodingData = GetData(FileUtils::ReadContentToU32String(inputPath));
-    FileUtils::AppendValueBinary(outputFile, encodingData.strLength);
+void CodecAC::EncodeSymbols(const std::u32string_view& input, BinaryWriter& writer)
+{
+    data encodingData = GetData(input);
+    writer.WriteValue(encodingData.strLength);
 
     while (!encodingData.queueLocalData.empty()) {
         auto elem = encodingData.queueLocalData.front();
 
-        FileUtils::AppendValueBinary(outputFile, elem.alphabetLength);
-        CodecUTF8::EncodeString32ToBinaryFile(outputFile, elem.alphabet);
+        writer.WriteValue(elem.alphabetLength);
+        CodecUTF8::EncodeString32ToBinaryFile(writer, elem.alphabet);
         for (uint8_t i = 0; i < elem.alphabetLength; ++i) {
-            FileUtils::AppendValueBinary(outputFile, elem.frequencies[i]);
+            writer.WriteValue(elem.frequencies[i]);
         }
-        FileUtils::AppendValueBinary(outputFile, elem.resultValue);
+        writer.WriteValue(elem.resultValue);
 
         encodingData.queueLocalData.pop();
     }
+}
+
+void CodecAC::Encode(const char* inputPath, const char* outputPath)
+{
+    FILE* outputFile = FileUtils::OpenFileBinaryWrite(outputPath);
+    BinaryWriter writer(outputFile);
+
+    EncodeSymbols(FileUtils::ReadContentToU32String(inputPath), writer);
+    writer.Flush();
     FileUtils::CloseFile(outputFile);
 }
 
 void CodecAC::Decode(const char* inputPath, const char* outputPath)
 {
     FILE* inputFile = FileUtils::OpenFileBinaryRead(inputPath);
+    BinaryReader reader(inputFile);
     std::ofstream outputFile = FileUtils::OpenFile<std::ofstream>(outputPath);
 
-    std::string decodedStr = DecodeAC(inputFile);
+    std::string decodedStr = DecodeAC(reader);
     FileUtils::AppendStr(outputFile, decodedStr);
 
     FileUtils::CloseFile(outputFile);
@@ -0,0 +1,287 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <vector>
+#include <map>
+#include <numeric>
+#include <algorithm>
+
+#include "FileUtils.h"
+#include "CodecUTF8.h"
+#include "UTF8Decoder.h"
+#include "HuffmanTree.h"
+#include "BitStream.h"
+
+/**
+ * Semi-adaptive Huffman algorithm
+ * encoder and decoder count characters in the same way and periodically rebuild the codes,
+ * so the input is read only once, memory is bounded by the alphabet and there are no tables in the output.
+ * characters without codes are written after the ESCAPE code as 21-bit numbers: new characters get codes
+ * on the next rebuild and only MAX_CODED_SYMBOLS most frequent symbols have them (the rest stay escaped)
+*/
+class CodecAdaptiveHA
+{
+private:
+    CodecAdaptiveHA() = default;
+protected:
+    static constexpr uint32_t ESCAPE = 0;
+    static constexpr uint32_t END_OF_STREAM = 1;
+    static constexpr uint8_t RAW_CHAR_BITS = 21;
+    static constexpr char32_t MAX_CODE_POINT = 0x10FFFF;
+    static constexpr uint8_t MAX_CODE_LENGTH = 15;
+    static constexpr size_t MAX_CODED_SYMBOLS = size_t(1) << MAX_CODE_LENGTH;
+    // codes are rebuilt after 64, 128, ..., 8192 characters
+    static constexpr uint32_t FIRST_REBUILD_INTERVAL = 1 << 6;
+    static constexpr uint32_t MAX_REBUILD_INTERVAL = 1 << 13;
+    // counts are halved when their sum gets bigger, so old statistics fade out
+    static constexpr uint64_t MAX_TOTAL_COUNT = 1 << 16;
+    static constexpr size_t INPUT_CHUNK_SIZE = 1 << 16;
+
+    // model of the characters which is updated identically by encoder and decoder
+    class Model {
+    public:
+        Model(const bool& _forDecoding);
+
+        // return index of the character (ESCAPE if it's unknown or it has no code)
+        uint32_t GetIndex(const char32_t& c) const;
+        // count the escaped character (a new one is added to the alphabet)
+        void CountEscaped(const char32_t& c);
+        // count the character and rebuild the codes if it's time
+        void Update(const uint32_t& index);
+
+        std::vector<char32_t> alphabet;
+        std::vector<uint8_t> codeLengths;
+        std::vector<uint32_t> codes;
+        HuffmanDecodingTable decodingTable;
+    private:
+        void BuildCodes();
+        void Rebuild();
+
+        bool forDecoding;
+        std::map<char32_t, uint32_t> charIndicesMap;
+        std::vector<uint64_t> counts;
+        uint64_t totalCount;
+        uint32_t rebuildInterval;
+        uint32_t charsUntilRebuild;
+    };
+public:
+    static void Encode(const char* inputPath, const char* outputPath);
+    static void Decode(const char* inputPath, const char* outputPath);
+
+    // streaming interface (files can be pipes, e.g. stdin and stdout)
+    class StreamEncoder {
+    public:
+        StreamEncoder(FILE* outputFile) : writer(outputFile), model(false) {}
+        void Put(const char32_t& c);
+        // write END_OF_STREAM and the rest of bits
+        void Finish();
+    private:
+        BitWriter writer;
+        Model model;
+    };
+    class StreamDecoder {
+    public:
+        StreamDecoder(FILE* inputFile) : reader(inputFile), model(true) {}
+        // return false at the end of the stream
+        bool Get(char32_t& c);
+    private:
+        BitReader reader;
+        Model model;
+    };
+};
+
+
+// START IMPLEMENTATION
+
+
+CodecAdaptiveHA::Model::Model(const bool& _forDecoding) : forDecoding(_forDecoding)
+{
+    // ESCAPE and END_OF_STREAM
+    alphabet = { 0, 0 };
+    counts = { 1, 1 };
+    totalCount = 2;
+    rebuildInterval = FIRST_REBUILD_INTERVAL;
+    charsUntilRebuild = rebuildInterval;
+    BuildCodes();
+}
+
+// characters added after the last rebuild are out of codeLengths
+uint32_t CodecAdaptiveHA::Model::GetIndex(const char32_t& c) const
+{
+    auto it = charIndicesMap.find(c);
+    if (it == charIndicesMap.end() || it->second >= codeLengths.size() || codeLengths[it->second] == 0) {
+        return ESCAPE;
+    }
+    return it->second;
+}
+
+void CodecAdaptiveHA::Model::CountEscaped(const char32_t& c)
+{
+    auto it = charIndicesMap.find(c);
+    if (it == charIndicesMap.end()) {
+        charIndicesMap.emplace(c, static_cast<uint32_t>(alphabet.size()));
+        alphabet.push_back(c);
+        counts.push_back(1);
+    } else {
+        ++counts[it->second];
+    }
+    ++totalCount;
+}
+
+void CodecAdaptiveHA::Model::Update(const uint32_t& index)
+{
+    ++counts[index];
+    ++totalCount;
+    if (--charsUntilRebuild == 0) {
+        Rebuild();
+    }
+}
+
+// ESCAPE and END_OF_STREAM always have codes, ties of counts are broken by indices,
+// so encoder and decoder choose the same characters
+void CodecAdaptiveHA::Model::BuildCodes()
+{
+    if (counts.size() <= MAX_CODED_SYMBOLS) {
+        codeLengths = GetLengthLimitedCodeLengths(counts, MAX_CODE_LENGTH);
+    } else {
+        std::vector<uint32_t> indices(counts.size() - 2);
+        std::iota(indices.begin(), indices.end(), 2);
+        auto codedEnd = indices.begin() + (MAX_CODED_SYMBOLS - 2);
+        std::nth_element(indices.begin(), codedEnd, indices.end(), [this](const uint32_t& a, const uint32_t& b) {
+            return counts[a] > counts[b] || (counts[a] == counts[b] && a < b);
+        });
+        std::vector<uint64_t> codedCounts = counts;
+        for (auto it = codedEnd; it != indices.end(); ++it) {
+            codedCounts[*it] = 0;
+        }
+        codeLengths = GetLengthLimitedCodeLengths(codedCounts, MAX_CODE_LENGTH);
+    }
+    if (forDecoding) {
+        BuildHuffmanDecodingTable(codeLengths, decodingTable);
+    } else {
+        codes = GetCanonicalCodes(codeLengths);
+    }
+}
+
+void CodecAdaptiveHA::Model::Rebuild()
+{
+    if (totalCount > MAX_TOTAL_COUNT) {
+        totalCount = 0;
+        for (uint64_t& count : counts) {
+            // every character keeps a count to be chosen for a code
+            count = std::max<uint64_t>(1, count / 2);
+            totalCount += count;
+        }
+    }
+    BuildCodes();
+
+    rebuildInterval = std::min(2 * rebuildInterval, MAX_REBUILD_INTERVAL);
+    charsUntilRebuild = rebuildInterval;
+}
+
+// ==========================================================================================================
+
+void CodecAdaptiveHA::StreamEncoder::Put(const char32_t& c)
+{
+    uint32_t index = model.GetIndex(c);
+    if (index == ESCAPE) {
+        writer.WriteBits(model.codes[ESCAPE], model.codeLengths[ESCAPE]);
+        writer.WriteBits(c, RAW_CHAR_BITS);
+        model.CountEscaped(c);
+        model.Update(ESCAPE);
+    } else {
+        writer.WriteBits(model.codes[index], model.codeLengths[index]);
+        model.Update(index);
+    }
+}
+
+void CodecAdaptiveHA::StreamEncoder::Finish()
+{
+    writer.WriteBits(model.codes[END_OF_STREAM], model.codeLengths[END_OF_STREAM]);
+    writer.Flush();
+}
+
+bool CodecAdaptiveHA::StreamDecoder::Get(char32_t& c)
+{
+    uint32_t index = DecodeHuffmanSymbol(reader, model.decodingTable);
+    if (index == ESCAPE) {
+        c = reader.ReadBits(RAW_CHAR_BITS);
+    }
+    // zeros after the end of a truncated stream would be decoded forever
+    if (reader.IsPastEnd()) {
+        throw std::runtime_error("Unexpected end of binary input");
+    }
+
+    if (index == END_OF_STREAM) {
+        return false;
+    } else if (index == ESCAPE) {
+        if (c > MAX_CODE_POINT) {
+            throw std::runtime_error("Wrong escaped character");
+        }
+        model.CountEscaped(c);
+        model.Update(ESCAPE);
+    } else {
+        c = model.alphabet[index];
+        model.Update(index);
+    }
+    return true;
+}
+
+// ==========================================================================================================
+
+void CodecAdaptiveHA::Encode(const char* inputPath, const char* outputPath)
+{
+    FILE* inputFile = FileUtils::OpenFileBinaryRead(inputPath);
+    FILE* outputFile = FileUtils::OpenFileBinaryWrite(outputPath);
+
+    StreamEncoder encoder(outputFile);
+
+    // read UTF-8 by chunks, incomplete character at the end of the chunk is moved to the next one
+    std::vector<uint8_t> chunk(INPUT_CHUNK_SIZE);
+    std::u32string decodedChunk(INPUT_CHUNK_SIZE, U'\0');
+    size_t restSize = 0;
+    size_t bytesRead;
+    while ((bytesRead = fread(chunk.data() + restSize, 1, INPUT_CHUNK_SIZE - restSize, inputFile)) > 0) {
+        size_t chunkSize = restSize + bytesRead;
+        size_t completeSize = UTF8Decoder::GetCompleteSize(chunk.data(), chunkSize);
+        size_t charsCount = UTF8Decoder::Decode(chunk.data(), completeSize, &decodedChunk[0]);
+        for (size_t i = 0; i < charsCount; ++i) {
+            encoder.Put(decodedChunk[i]);
+        }
+        restSize = chunkSize - completeSize;
+        std::copy(chunk.begin() + completeSize, chunk.begin() + chunkSize, chunk.begin());
+    }
+    if (restSize > 0) {
+        throw std::runtime_error("Can't decode byte in UTF-8");
+    }
+    encoder.Finish();
+
+    FileUtils::CloseFile(outputFile);
+    FileUtils::CloseFile(inputFile);
+}
+
+void CodecAdaptiveHA::Decode(const char* inputPath, const char* outputPath)
+{
+    FILE* inputFile = FileUtils::OpenFileBinaryRead(inputPath);
+    FILE* outputFile = FileUtils::OpenFileBinaryWrite(outputPath);
+
+    StreamDecoder decoder(inputFile);
+
+    // write UTF-8 by chunks
+    std::u32string decodedChunk; decodedChunk.reserve(INPUT_CHUNK_SIZE);
+    char32_t c;
+    while (decoder.Get(c)) {
+        decodedChunk.push_back(c);
+        if (decodedChunk.size() == INPUT_CHUNK_SIZE) {
+            FileUtils::AppendStrBinary(outputFile, CodecUTF8::EncodeString32ToString(decodedChunk));
+            decodedChunk.clear();
+        }
+    }
+    FileUtils::AppendStrBinary(outputFile, CodecUTF8::EncodeString32ToString(decodedChunk));
+
+    FileUtils::CloseFile(outputFile);
+    FileUtils::CloseFile(inputFile);
+}
+
+// END IMPLEMENTATION
@@ -1,11 +1,16 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <cstdint>
+#include <vector>
+#include <stdexcept>
 
 #include "FileUtils.h"
+#include "BinaryStream.h"
 #include "CodecUTF8.h"
 #include "SuffixArray.h"
+#include "AlphabetMap.h"
 
 class CodecBWT
 {
@@ -14,6 +19,10 @@ private:
 public:
     static void Encode(const char* inputPath, const char* outputPath);
     static void Decode(const char* inputPath, const char* outputPath);
+
+    // stage of CodecPipeline: symbols are transformed to output, the index is written to the header
+    static void EncodeSymbols(const std::u32string_view& input, std::u32string& output, BinaryWriter& header);
+    static void DecodeSymbols(const std::u32string_view& input, std::u32string& output, BinaryReader& header);
 protected:
     struct data {
         uint32_t index;
@@ -21,15 +30,23 @@ protected:
         data(const uint32_t& _index, const std::u32string& _encodedStr) : index(_index), encodedStr(_encodedStr) {}
     };
 
+    // write the transformed string to encodedStr, return the index
+    static uint32_t Transform(const std::u32string_view& inputStr, std::u32string& encodedStr);
     static data GetData(const std::u32string& inputStr);
-    static std::u32string DecodeBWT(FILE* inputFile);
+    template <typename rankType>
+    static std::vector<rankType> GetInverseRanks(const std::vector<rankType>& ranks, const size_t& alphabetLength, const uint32_t& index);
+    template <typename rankType>
+    static std::string DecodeRanks(const std::vector<rankType>& ranks, const AlphabetMap& alphabetMap, const uint32_t& index);
+    static std::string DecodeBWT(BinaryReader& reader);
 };
 
 
 // START IMPLEMENTATION
 
 
-CodecBWT::data CodecBWT::GetData(const std::u32string& inputStr)
+// last characters of the sorted suffixes (the end of the string is smaller than all the characters),
+// the suffix of the whole string gets the last character instead of the end, its position is the index
+uint32_t CodecBWT::Transform(const std::u32string_view& inputStr, std::u32string& encodedStr)
 {
     // NOTE:
     // will encode every 10 * 1024 * 1024 (10 Mb in the worst case, else even more Mb)
@@ -40,9 +57,9 @@ CodecBWT::data CodecBWT::GetData(const std::u32string& inputStr)
     // so enwik8 will use about 500mb of RAM
     //const size_t MAX_COUNT_OF_CHARS = 10 * 1024 * 1024;
 
-    uint32_t index;
-    std::u32string encodedStr; encodedStr.reserve(inputStr.size());
-    std::vector<unsigned int> suffixArray = buildSuffixArray(inputStr);
+    uint32_t index = 0;
+    encodedStr.clear(); encodedStr.reserve(inputStr.size());
+    std::vector<unsigned int> suffixArray = buildSuffixArray(std::u32string(inputStr));
     for (size_t i = 0; i < suffixArray.size(); ++i) {
         size_t ind = (suffixArray[i] > 0) ? (suffixArray[i] - 1) : (inputStr.size() - 1);
         encodedStr.push_back(inputStr[ind]);
@@ -50,49 +67,115 @@ CodecBWT::data CodecBWT::GetData(const std::u32string& inputStr)
             index = i;
         }
     }
+    return index;
+}
 
+CodecBWT::data CodecBWT::GetData(const std::u32string& inputStr)
+{
+    std::u32string encodedStr;
+    uint32_t index = Transform(inputStr, encodedStr);
     return data(index, encodedStr);
 }
 
-std::u32string CodecBWT::DecodeBWT(FILE* inputFile)
+// the last column with the end is restored: the row of the end (the first one) has the character of the index
+// and the index has the end. the stable sort of the characters is a counting sort of their ranks (the end is the first)
+template <typename rankType>
+std::vector<rankType> CodecBWT::GetInverseRanks(const std::vector<rankType>& ranks, const size_t& alphabetLength, const uint32_t& index)
 {
-    uint32_t index = FileUtils::ReadValueBinary<uint32_t>(inputFile);
-    uint64_t strSize = FileUtils::ReadValueBinary<uint64_t>(inputFile);
-    std::u32string inputStr = CodecUTF8::DecodeString32FromBinaryFile(inputFile, strSize);
+    if (ranks.empty()) {
+        return ranks;
+    }
+    if (index >= ranks.size()) {
+        throw std::runtime_error("Wrong BWT index");
+    }
+    // rank of the row of the last column (rows after the first one are the rows of ranks)
+    auto getRank = [&](const size_t& row) { return ranks[(row == 0) ? index : row - 1]; };
 
-    std::vector<std::pair<char32_t, unsigned int>> P; P.reserve(inputStr.size());
-    for (uint64_t i = 0; i < strSize; ++i) {
-        P.push_back(std::make_pair(inputStr[i], i));
+    std::vector<size_t> starts(alphabetLength + 1, 0);
+    for (rankType rank : ranks) {
+        ++starts[rank + size_t(1)];
+    }
+    starts[0] = 1;
+    for (size_t i = 1; i < starts.size(); ++i) {
+        starts[i] += starts[i - 1];
+    }
+    std::vector<uint32_t> sortedPositions(ranks.size() + 1);
+    sortedPositions[0] = index + 1;
+    for (size_t row = 0; row <= ranks.size(); ++row) {
+        if (row != index + size_t(1)) {
+            sortedPositions[starts[getRank(row)]++] = static_cast<uint32_t>(row);
+        }
     }
-    std::sort(P.begin(), P.end());
 
-    std::u32string decodedStr; decodedStr.reserve(inputStr.size());
-    for (size_t i = 0; i < inputStr.size(); ++i) {
-        index = P[index].second;
-        decodedStr.push_back(inputStr[index]);
+    std::vector<rankType> decodedRanks(ranks.size());
+    size_t row = index + 1;
+    for (size_t i = 0; i < ranks.size(); ++i) {
+        row = sortedPositions[row];
+        decodedRanks[i] = getRank(row);
     }
+    return decodedRanks;
+}
 
+template <typename rankType>
+std::string CodecBWT::DecodeRanks(const std::vector<rankType>& ranks, const AlphabetMap& alphabetMap, const uint32_t& index)
+{
+    std::vector<rankType> decodedRanks = GetInverseRanks(ranks, alphabetMap.GetSize(), index);
+    return alphabetMap.GetUTF8String(decodedRanks.data(), decodedRanks.size());
+}
+
+std::string CodecBWT::DecodeBWT(BinaryReader& reader)
+{
+    uint32_t index = reader.ReadValue<uint32_t>();
+    uint64_t strSize = reader.ReadValue<uint64_t>();
+    std::u32string inputStr = CodecUTF8::DecodeString32FromBinaryFile(reader, strSize);
+
+    std::string decodedStr;
+    AlphabetMap alphabetMap(inputStr);
+    alphabetMap.VisitRanks(inputStr, [&](const auto& ranks) {
+        decodedStr = DecodeRanks(ranks, alphabetMap, index);
+    });
     return decodedStr;
 }
 
+void CodecBWT::EncodeSymbols(const std::u32string_view& input, std::u32string& output, BinaryWriter& header)
+{
+    header.WriteValue(Transform(input, output));
+}
+
+void CodecBWT::DecodeSymbols(const std::u32string_view& input, std::u32string& output, BinaryReader& header)
+{
+    uint32_t index = header.ReadValue<uint32_t>();
+    AlphabetMap alphabetMap(input);
+    alphabetMap.VisitRanks(input, [&](const auto& ranks) {
+        auto decodedRanks = GetInverseRanks(ranks, alphabetMap.GetSize(), index);
+        output.resize(decodedRanks.size());
+        for (size_t i = 0; i < decodedRanks.size(); ++i) {
+            output[i] = alphabetMap.GetAlphabet()[decodedRanks[i]];
+        }
+    });
+}
+
 void CodecBWT::Encode(const char* inputPath, const char* outputPath)
 {
     FILE* outputFile = FileUtils::OpenFileBinaryWrite(outputPath);
+    BinaryWriter writer(outputFile);
 
     data encodingData = GetData(FileUtils::ReadContentToU32String(inputPath));
-    FileUtils::AppendValueBinary(outputFile, encodingData.index);
-    FileUtils::AppendValueBinary(outputFile, static_cast<uint64_t>(encodingData.encodedStr.size()));
-    CodecUTF8::EncodeString32ToBinaryFile(outputFile, encodingData.encodedStr);
+    writer.WriteValue(encodingData.index);
+    writer.WriteValue(static_cast<uint64_t>(encodingData.encodedStr.size()));
+    CodecUTF8::EncodeString32ToBinaryFile(writer, encodingData.encodedStr);
 
+    writer.Flush();
     FileUtils::CloseFile(outputFile);
 }
 
 void CodecBWT::Decode(const char* inputPath, const char* outputPath)
 {
     FILE* inputFile = FileUtils::OpenFileBinaryRead(inputPath);
+    BinaryReader reader(inputFile);
     std::ofstream outputFile = FileUtils::OpenFile<std::ofstream>(outputPath);
 
-    std::string decodedStr = CodecUTF8::EncodeString32ToString(DecodeBWT(inputFile));
+    std::string decodedStr = DecodeBWT(reader);
     FileUtils::AppendStr(outputFile, decodedStr);
 
     FileUtils::CloseFile(outputFile);
@@ -1,14 +1,18 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <cstdint>
-#include <map>
 #include <queue>
+#include <vector>
+#include <cmath> // for std::log2
 
 #include "FileUtils.h"
+#include "BinaryStream.h"
 #include "CodecUTF8.h"
 #include "HuffmanTree.h"
-#include "TextTools.h"
+#include "BitStream.h"
+#include "AlphabetMap.h"
 
 
 class CodecHA
@@ -18,272 +22,435 @@ private:
 public:
     static void Encode(const char* inputPath, const char* outputPath);
     static void Decode(const char* inputPath, const char* outputPath);
+
+    // stage of CodecPipeline: symbols are encoded to the writer
+    static void EncodeSymbols(const std::u32string_view& input, BinaryWriter& writer);
+    static void DecodeSymbols(BinaryReader& reader, std::u32string& output);
 protected:
+    // lengths of codes are delta-coded with 4 bits
+    static constexpr uint8_t MAX_CODE_LENGTH = 15;
+    // prefix codes of MAX_CODE_LENGTH bits can't be given to more characters of a block
+    static constexpr size_t MAX_BLOCK_ALPHABET_LENGTH = size_t(1) << MAX_CODE_LENGTH;
+    // NEW_TABLE - block starts with the delta-coded lengths of codes
+    // REPEAT_TABLE - block uses the table of the previous block
+    enum TableType : uint8_t { NEW_TABLE = 0, REPEAT_TABLE = 1 };
+    // big blocks are split into 4 segments with separate bitstreams,
+    // so the decoder can decode them in one interleaved loop
+    static constexpr uint8_t STREAMS_COUNT = 4;
+    static constexpr size_t MIN_MULTISTREAM_BLOCK_LENGTH = 1 << 10;
+
     struct data_local {
-        uint8_t alphabetLength;
-        std::u32string alphabet;
-        std::map<char32_t, std::string> huffmanCodesMap;
-        std::string encodedStr;
-        data_local(const uint8_t& _alphabetLength, const std::u32string& _alphabet, const std::map<char32_t, std::string>& _huffmanCodesMap, const std::string& _encodedStr) : alphabetLength(_alphabetLength), alphabet(_alphabet), huffmanCodesMap(_huffmanCodesMap), encodedStr(_encodedStr) {}
+        uint8_t tableType;
+        uint8_t streamsCount;
+        uint64_t blockLength;
+        // table (if it's new) and codes of the characters
+        // it starts with the jump table: sizes of the table and of all the streams except the last (uint32_t each)
+        std::vector<uint8_t> encodedBytes;
+        data_local(const uint8_t& _tableType, const uint8_t& _streamsCount, const uint64_t& _blockLength, const std::vector<uint8_t>& _encodedBytes) : tableType(_tableType), streamsCount(_streamsCount), blockLength(_blockLength), encodedBytes(_encodedBytes) {}
     };
     struct data {
+        AlphabetMap alphabetMap;
         std::queue<data_local> queueLocalData;
-        data(const std::queue<data_local>& _queueLocalData) : queueLocalData(_queueLocalData) {}
+        data(const AlphabetMap& _alphabetMap, const std::queue<data_local>& _queueLocalData) : alphabetMap(_alphabetMap), queueLocalData(_queueLocalData) {}
     };
 
-    static uint8_t GetNumberFromBinaryString(const std::string& binaryString);
-    static std::string GetBinaryStringFromNumber(const uint8_t& number, const uint8_t& codeLength);
-
-    static data GetData(const std::u32string& inputStr);
-    static std::u32string DecodeHA(FILE* inputFile);
+    static double GetBlockCost(const std::vector<uint64_t>& charCounts, const uint64_t& blockLength);
+    template <typename rankType>
+    static std::vector<size_t> GetBlockBounds(const std::vector<rankType>& inputRanks, const size_t& alphabetLength);
+    static void WriteCodeLengths(BitWriter& writer, const std::vector<uint8_t>& codeLengths, const std::vector<uint8_t>& previousCodeLengths);
+    static void ReadCodeLengths(BitReader& reader, std::vector<uint8_t>& codeLengths);
+    static void AppendUint32(std::vector<uint8_t>& bytes, const uint32_t& value);
+    static uint32_t GetUint32(const std::vector<uint8_t>& bytes, const size_t& position);
+    template <typename rankType>
+    static void DecodeStreams(const std::vector<uint8_t>& encodedBytes, const size_t& streamsStart, const uint64_t& blockLength, 
+                              const HuffmanDecodingTable& decodingTable, rankType* output);
+    template <typename rankType>
+    static data_local GetDataLocal(const std::vector<rankType>& inputRanks, const size_t& blockStart, const size_t& blockEnd, 
+                                   const size_t& alphabetLength, std::vector<uint8_t>& codeLengths);
+    static data GetData(const std::u32string_view& inputStr);
+    // decode the blocks to the ranks of the alphabet
+    template <typename rankType>
+    static std::vector<rankType> DecodeBlocks(BinaryReader& reader, const size_t& alphabetLength);
+    static std::string DecodeHA(BinaryReader& reader);
+    template <typename rankType>
+    static void DecodeSymbols(BinaryReader& reader, const AlphabetMap& alphabetMap, std::u32string& output);
 };
 
 
 // START IMPLEMENTATION
 
 
-uint8_t CodecHA::GetNumberFromBinaryString(const std::string& binaryString)
+// estimated size of the encoded block in bits (entropy of the block + size of its table)
+double CodecHA::GetBlockCost(const std::vector<uint64_t>& charCounts, const uint64_t& blockLength)
 {
-    uint8_t result = 0;
-    for (size_t i = 0; i < binaryString.size(); ++i) {
-        if (binaryString[i] == '1') {
-            result |= (1 << (binaryString.length() - i - 1));
+    // delta-coded length of one character in the table
+    const double charTableCost = 5.0;
+    // tableType, streamsCount, blockLength and size of encodedBytes
+    const double blockHeaderCost = 144.0;
+    // uint32_t sizes of the table and of all the streams except the last
+    const double jumpTableCost = 32.0 * ((blockLength >= MIN_MULTISTREAM_BLOCK_LENGTH) ? STREAMS_COUNT : 1);
+
+    double cost = blockHeaderCost + jumpTableCost;
+    for (const uint64_t& count : charCounts) {
+        if (count > 0) {
+            cost += charTableCost + count * std::log2(static_cast<double>(blockLength) / count);
         }
     }
-    return result;
+    return cost;
 }
 
-std::string CodecHA::GetBinaryStringFromNumber(const uint8_t& number, const uint8_t& codeLength)
+// split inputRanks into blocks [bounds[i], bounds[i + 1])
+// the string is split only if separate tables pay for themselves or the block would have too many characters
+template <typename rankType>
+std::vector<size_t> CodecHA::GetBlockBounds(const std::vector<rankType>& inputRanks, const size_t& alphabetLength)
 {
-    std::string result(codeLength, '0');
-    for (uint8_t i = 0; i < codeLength; ++i) {
-        if (number & (1 << (codeLength - i - 1))) {
-            result[i] = '1';
+    // candidate split points are at the ends of segments (a segment always fits into MAX_BLOCK_ALPHABET_LENGTH)
+    const size_t segmentLength = 1 << 14;
+    const size_t maxBlockLength = 1 << 20;
+
+    std::vector<size_t> bounds(1, 0);
+    std::vector<uint64_t> blockCounts(alphabetLength, 0), segmentCounts(alphabetLength, 0), mergedCounts(alphabetLength, 0);
+    size_t blockLength = 0;
+    size_t stringPointer = 0;
+
+    while (stringPointer < inputRanks.size()) {
+        // get the next segment
+        std::fill(segmentCounts.begin(), segmentCounts.end(), 0);
+        size_t segmentEnd = std::min(inputRanks.size(), stringPointer + segmentLength);
+        for (size_t i = stringPointer; i < segmentEnd; ++i) {
+            ++segmentCounts[inputRanks[i]];
+        }
+        size_t currentSegmentLength = segmentEnd - stringPointer;
+
+        // decide if the segment should be appended to the current block
+        bool merge = false;
+        if (blockLength > 0 && blockLength + currentSegmentLength <= maxBlockLength) {
+            size_t mergedAlphabetLength = 0;
+            for (size_t i = 0; i < alphabetLength; ++i) {
+                mergedCounts[i] = blockCounts[i] + segmentCounts[i];
+                mergedAlphabetLength += (mergedCounts[i] > 0) ? 1 : 0;
+            }
+            merge = mergedAlphabetLength <= MAX_BLOCK_ALPHABET_LENGTH &&
+                    (GetBlockCost(mergedCounts, blockLength + currentSegmentLength) <= 
+                     GetBlockCost(blockCounts, blockLength) + GetBlockCost(segmentCounts, currentSegmentLength));
+        }
+
+        if (merge) {
+            std::swap(blockCounts, mergedCounts);
+            blockLength += currentSegmentLength;
+        } else {
+            // start a new block with the segment
+            if (blockLength > 0) {
+                bounds.push_back(stringPointer);
+            }
+            std::swap(blockCounts, segmentCounts);
+            blockLength = currentSegmentLength;
         }
+        stringPointer = segmentEnd;
     }
-    return result;
-} 
+    if (blockLength > 0) {
+        bounds.push_back(inputRanks.size());
+    }
+
+    return bounds;
+}
 
-CodecHA::data CodecHA::GetData(const std::u32string& inputStr)
+// every length is coded relative to the same character in the previous table:
+// '0' if it's the same, else '1' and 4 bits of (length - previousLength) mod 16
+void CodecHA::WriteCodeLengths(BitWriter& writer, const std::vector<uint8_t>& codeLengths, const std::vector<uint8_t>& previousCodeLengths)
 {
-    std::queue<data_local> queueLocalData;
+    for (size_t i = 0; i < codeLengths.size(); ++i) {
+        uint8_t delta = (codeLengths[i] - previousCodeLengths[i]) & 0xF;
+        if (delta == 0) {
+            writer.WriteBit(false);
+        } else {
+            writer.WriteBit(true);
+            writer.WriteBits(delta, 4);
+        }
+    }
+}
 
-    const size_t strLengthToStart = 50;
-    const size_t strLengthToAppend = 10;
-    const size_t maxHuffmanCodeLength = 8;
-    uint8_t maxHuffmanCodeLengthCounter;
-    size_t stringPointer = 0;
-    std::u32string localString;
-
-    std::set<char32_t> alphabetSet;
-    std::map<char32_t, size_t> charCountsMap;
-    std::vector<std::pair<char32_t, double>> charFrequenciesVector;
-
-    double frequency; // temporary variable
-
-
-    // get all the data_local
-    while (stringPointer < inputStr.size()) {
-        // inicialization
-        localString = inputStr.substr(stringPointer, strLengthToStart);
-        alphabetSet = GetAlphabetSet(localString);
-        charCountsMap = GetCharCountsMap(std::u32string(alphabetSet.begin(), alphabetSet.end()), alphabetSet.size(), localString);
-        charFrequenciesVector = std::vector<std::pair<char32_t, double>>(charCountsMap.begin(), charCountsMap.end());
-        for (size_t i = 0; i < charFrequenciesVector.size(); ++i) {
-            frequency = charFrequenciesVector[i].second / static_cast<double>(alphabetSet.size());
-            // leave in frequencies only 2 digits after the decimal point
-            charFrequenciesVector[i].second = std::trunc((frequency * 100.0)) / 100.0;
+// codeLengths must contain the previous table, it's replaced with the new one
+void CodecHA::ReadCodeLengths(BitReader& reader, std::vector<uint8_t>& codeLengths)
+{
+    for (size_t i = 0; i < codeLengths.size(); ++i) {
+        if (reader.ReadBit()) {
+            codeLengths[i] = (codeLengths[i] + reader.ReadBits(4)) & 0xF;
         }
-        // sort vector by frequencies
-        std::sort(charFrequenciesVector.begin(), charFrequenciesVector.end(), [](const auto& a, const auto& b) {
-            return a.second < b.second;
-        });
-        
-
-        while (true) {
-            // get maxHuffmanCodeLengthCounter
-            HuffmanTree tree = BuildHuffmanTree(charFrequenciesVector, alphabetSet.size());
-            maxHuffmanCodeLengthCounter = tree.GetHeight();
-            if ((maxHuffmanCodeLengthCounter > maxHuffmanCodeLength) || 
-                (alphabetSet.size() > 100)) {
-                // reset data to the last modification where maxHuffmanCodeLengthCounter <= maxHuffmanCodeLength
-
-                localString.erase(localString.size() - strLengthToAppend); // remove last 10 characters
-                alphabetSet = GetAlphabetSet(localString);
-                charCountsMap = GetCharCountsMap(std::u32string(alphabetSet.begin(), alphabetSet.end()), alphabetSet.size(), localString);
-                charFrequenciesVector = std::vector<std::pair<char32_t, double>>(charCountsMap.begin(), charCountsMap.end());
-                for (size_t i = 0; i < charFrequenciesVector.size(); ++i) {
-                    frequency = charFrequenciesVector[i].second / static_cast<double>(alphabetSet.size());
-                    // leave in frequencies only 2 digits after the decimal point
-                    charFrequenciesVector[i].second = std::trunc((frequency * 100.0)) / 100.0;
-                }
-                // sort vector by frequencies
-                std::sort(charFrequenciesVector.begin(), charFrequenciesVector.end(), [](const auto& a, const auto& b) {
-                    return a.second < b.second;
-                });
-
-                break;
-            } else if (stringPointer + localString.size() >= inputStr.size()) {
-                break;
-            }
+    }
+}
 
-            // modify the data
-            // expand localString
-            localString += inputStr.substr(stringPointer + localString.size(), strLengthToAppend);
-            // expand alphabetSet and charCountsMap
-            for (size_t i = localString.size() - strLengthToAppend; i < localString.size(); ++i) {
-                alphabetSet.insert(localString[i]);
-                ++charCountsMap[localString[i]];
-            }
-            // get charFrequenciesVector
-            charFrequenciesVector = std::vector<std::pair<char32_t, double>>(charCountsMap.begin(), charCountsMap.end());
-            for (size_t i = 0; i < charFrequenciesVector.size(); ++i) {
-                frequency = charFrequenciesVector[i].second / static_cast<double>(alphabetSet.size());
-                // leave in frequencies only 2 digits after the decimal point
-                charFrequenciesVector[i].second = std::trunc((frequency * 100.0)) / 100.0;
-            }
-            // sort vector by frequencies
-            std::sort(charFrequenciesVector.begin(), charFrequenciesVector.end(), [](const auto& a, const auto& b) {
-                return a.second < b.second;
-            });
+// little-endian uint32_t inside of the encoded block
+void CodecHA::AppendUint32(std::vector<uint8_t>& bytes, const uint32_t& value)
+{
+    for (int i = 0; i < 4; ++i) {
+        bytes.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+}
+
+uint32_t CodecHA::GetUint32(const std::vector<uint8_t>& bytes, const size_t& position)
+{
+    uint32_t value = 0;
+    for (int i = 3; i >= 0; --i) {
+        value = (value << 8) | bytes[position + i];
+    }
+    return value;
+}
+
+// codeLengths must contain the table of the previous block, it's replaced with the table of this block
+template <typename rankType>
+CodecHA::data_local CodecHA::GetDataLocal(const std::vector<rankType>& inputRanks, const size_t& blockStart, const size_t& blockEnd, 
+                                          const size_t& alphabetLength, std::vector<uint8_t>& codeLengths)
+{
+    std::vector<uint64_t> charCounts(alphabetLength, 0);
+    for (size_t i = blockStart; i < blockEnd; ++i) {
+        ++charCounts[inputRanks[i]];
+    }
+    std::vector<uint8_t> newCodeLengths = GetLengthLimitedCodeLengths(charCounts, MAX_CODE_LENGTH);
+
+    // compare sizes of the block with the previous table and with the new one
+    uint64_t newTableCost = 0, newCodesCost = 0, previousCodesCost = 0;
+    bool previousTableFits = true;
+    for (size_t i = 0; i < alphabetLength; ++i) {
+        newTableCost += (newCodeLengths[i] == codeLengths[i]) ? 1 : 5;
+        newCodesCost += charCounts[i] * newCodeLengths[i];
+        previousCodesCost += charCounts[i] * codeLengths[i];
+        if (charCounts[i] > 0 && codeLengths[i] == 0) {
+            previousTableFits = false;
         }
+    }
 
-        
-        HuffmanTree tree = BuildHuffmanTree(charFrequenciesVector, alphabetSet.size());
-        std::map<char32_t, std::string> huffmanCodesMap = GetHuffmanCodes(tree, alphabetSet.size());
-        std::string encodedStr;
-        // !!!!!
-        // AM I RIGHT THAT I SHOULD ENCODE LOCAL STRING?
-        for (size_t i = 0; i < localString.size(); ++i) {
-            encodedStr += huffmanCodesMap[localString[i]];
+    uint8_t tableType = REPEAT_TABLE;
+    BitWriter tableWriter;
+    if (!previousTableFits || newTableCost + newCodesCost < previousCodesCost) {
+        tableType = NEW_TABLE;
+        WriteCodeLengths(tableWriter, newCodeLengths, codeLengths);
+        codeLengths = newCodeLengths;
+    }
+    tableWriter.Flush();
+
+    // encode segments of the block to separate streams
+    uint64_t blockLength = blockEnd - blockStart;
+    uint8_t streamsCount = (blockLength >= MIN_MULTISTREAM_BLOCK_LENGTH) ? STREAMS_COUNT : 1;
+    uint64_t segmentLength = (blockLength + streamsCount - 1) / streamsCount;
+    std::vector<uint32_t> codes = GetCanonicalCodes(codeLengths);
+    std::vector<BitWriter> streamWriters(streamsCount);
+    for (uint8_t k = 0; k < streamsCount; ++k) {
+        size_t segmentEnd = std::min(blockEnd, blockStart + (k + 1) * segmentLength);
+        for (size_t i = blockStart + k * segmentLength; i < segmentEnd; ++i) {
+            streamWriters[k].WriteBits(codes[inputRanks[i]], codeLengths[inputRanks[i]]);
         }
-        queueLocalData.push(data_local(alphabetSet.size(), std::u32string(alphabetSet.begin(), alphabetSet.end()), huffmanCodesMap, encodedStr));
-        
-        // print to see compression ratio of huffman result sequence
-        //std::cout << "local part: " << localString.size() << " -> "
-        //          << encodedStr.size() / static_cast<double>(8) << std::endl;
-        
-        // move stringPointer
-        stringPointer += localString.size();
+        streamWriters[k].Flush();
+    }
+
+    // join the table and the streams
+    std::vector<uint8_t> encodedBytes;
+    AppendUint32(encodedBytes, tableWriter.GetBytes().size());
+    for (uint8_t k = 0; k + 1 < streamsCount; ++k) {
+        AppendUint32(encodedBytes, streamWriters[k].GetBytes().size());
     }
+    encodedBytes.insert(encodedBytes.end(), tableWriter.GetBytes().begin(), tableWriter.GetBytes().end());
+    for (uint8_t k = 0; k < streamsCount; ++k) {
+        encodedBytes.insert(encodedBytes.end(), streamWriters[k].GetBytes().begin(), streamWriters[k].GetBytes().end());
+    }
+
+    return data_local(tableType, streamsCount, blockLength, encodedBytes);
+}
+
+CodecHA::data CodecHA::GetData(const std::u32string_view& inputStr)
+{
+    std::queue<data_local> queueLocalData;
+
+    // characters are replaced with the ranks of the alphabet to count them in arrays
+    AlphabetMap alphabetMap(inputStr);
+    alphabetMap.VisitRanks(inputStr, [&](const auto& inputRanks) {
+        std::vector<uint8_t> codeLengths(alphabetMap.GetSize(), 0);
+        std::vector<size_t> bounds = GetBlockBounds(inputRanks, alphabetMap.GetSize());
+        for (size_t i = 0; i + 1 < bounds.size(); ++i) {
+            queueLocalData.push(GetDataLocal(inputRanks, bounds[i], bounds[i + 1], alphabetMap.GetSize(), codeLengths));
+        }
+    });
     
-    return data(queueLocalData);
+    return data(alphabetMap, queueLocalData);
 }
 
-std::u32string CodecHA::DecodeHA(FILE* inputFile)
+// decode STREAMS_COUNT segments of the block in one loop
+// (streams don't depend on each other, so processor can decode them in parallel)
+template <typename rankType>
+void CodecHA::DecodeStreams(const std::vector<uint8_t>& encodedBytes, const size_t& streamsStart, const uint64_t& blockLength, 
+                            const HuffmanDecodingTable& decodingTable, rankType* output)
 {
-    uint64_t numberOfLocalData = FileUtils::ReadValueBinary<uint64_t>(inputFile);
-    std::u32string decodedStr;
+    static_assert(STREAMS_COUNT == 4, "the streams are decoded by four readers");
+
+    // get bounds of the streams from the jump table (streamsStart is inside of the block)
+    size_t streamBounds[STREAMS_COUNT + 1];
+    streamBounds[0] = streamsStart;
+    for (uint8_t k = 1; k < STREAMS_COUNT; ++k) {
+        size_t streamSize = GetUint32(encodedBytes, 4 * k);
+        if (streamSize > encodedBytes.size() - streamBounds[k - 1]) {
+            throw std::runtime_error("Wrong HA stream size");
+        }
+        streamBounds[k] = streamBounds[k - 1] + streamSize;
+    }
+    streamBounds[STREAMS_COUNT] = encodedBytes.size();
+
+    BitReader reader0(encodedBytes.data() + streamBounds[0], streamBounds[1] - streamBounds[0]);
+    BitReader reader1(encodedBytes.data() + streamBounds[1], streamBounds[2] - streamBounds[1]);
+    BitReader reader2(encodedBytes.data() + streamBounds[2], streamBounds[3] - streamBounds[2]);
+    BitReader reader3(encodedBytes.data() + streamBounds[3], streamBounds[4] - streamBounds[3]);
+
+    // all the segments have the same length except the last one
+    uint64_t segmentLength = (blockLength + STREAMS_COUNT - 1) / STREAMS_COUNT;
+    uint64_t lastSegmentLength = blockLength - 3 * segmentLength;
+    rankType* output0 = output;
+    rankType* output1 = output + segmentLength;
+    rankType* output2 = output + 2 * segmentLength;
+    rankType* output3 = output + 3 * segmentLength;
+
+    for (uint64_t j = 0; j < lastSegmentLength; ++j) {
+        output0[j] = static_cast<rankType>(DecodeHuffmanSymbol(reader0, decodingTable));
+        output1[j] = static_cast<rankType>(DecodeHuffmanSymbol(reader1, decodingTable));
+        output2[j] = static_cast<rankType>(DecodeHuffmanSymbol(reader2, decodingTable));
+        output3[j] = static_cast<rankType>(DecodeHuffmanSymbol(reader3, decodingTable));
+    }
+    for (uint64_t j = lastSegmentLength; j < segmentLength; ++j) {
+        output0[j] = static_cast<rankType>(DecodeHuffmanSymbol(reader0, decodingTable));
+        output1[j] = static_cast<rankType>(DecodeHuffmanSymbol(reader1, decodingTable));
+        output2[j] = static_cast<rankType>(DecodeHuffmanSymbol(reader2, decodingTable));
+    }
+}
 
-    for (uint64_t i = 0; i < numberOfLocalData; ++i) {
-        uint8_t alphabetLength = FileUtils::ReadValueBinary<uint8_t>(inputFile);
-        std::u32string alphabet = CodecUTF8::DecodeString32FromBinaryFile(inputFile, alphabetLength);
+template <typename rankType>
+std::vector<rankType> CodecHA::DecodeBlocks(BinaryReader& reader, const size_t& alphabetLength)
+{
+    uint64_t numberOfLocalData = reader.ReadValue<uint64_t>();
+    std::vector<rankType> decodedRanks;
 
-        uint8_t lengthsOfCodesSize = alphabetLength;
-        std::string lengthsOfCodes = FileUtils::ReadSequenceOfDigitsBinary(inputFile, lengthsOfCodesSize);
+    std::vector<uint8_t> codeLengths(alphabetLength, 0);
+    HuffmanDecodingTable decodingTable;
+    bool hasTable = false;
 
-        // get length of all the huffman codes
-        uint16_t allHuffmanCodesSize = 0;
-        for (char c : lengthsOfCodes) {
-            allHuffmanCodesSize += c - '0';
-        }
-        // read string of encoded huffman codes
-        std::string allHuffmanCodes;
-        for (uint16_t j = 0; j < allHuffmanCodesSize - allHuffmanCodesSize % 8; j += 8) {
-            allHuffmanCodes += GetBinaryStringFromNumber(FileUtils::ReadValueBinary<uint8_t>(inputFile), 8);
+    for (uint64_t i = 0; i < numberOfLocalData; ++i) {
+        uint8_t tableType = reader.ReadValue<uint8_t>();
+        uint8_t streamsCount = reader.ReadValue<uint8_t>();
+        uint64_t blockLength = reader.ReadValue<uint64_t>();
+        uint64_t encodedBytesSize = reader.ReadValue<uint64_t>();
+        // every character takes at least one bit, big blocks are always split into STREAMS_COUNT streams
+        if (blockLength / 8 > encodedBytesSize || (blockLength > 0 && alphabetLength == 0)) {
+            throw std::runtime_error("Wrong HA block");
         }
-        if (allHuffmanCodesSize % 8 != 0) {
-            allHuffmanCodes += GetBinaryStringFromNumber(FileUtils::ReadValueBinary<uint8_t>(inputFile), allHuffmanCodesSize % 8);
+        if (streamsCount != ((blockLength >= MIN_MULTISTREAM_BLOCK_LENGTH) ? STREAMS_COUNT : 1)) {
+            throw std::runtime_error("Wrong HA streams count");
         }
-        // get huffman codes map
-        std::map<std::string, char32_t> huffmanCodesMap;
-        size_t stringPointer = 0;
-        for (size_t j = 0; j < alphabet.size(); ++j) {
-            huffmanCodesMap[allHuffmanCodes.substr(stringPointer, lengthsOfCodes[j] - '0')] = alphabet[j];
-            stringPointer += lengthsOfCodes[j] - '0';
+        std::vector<uint8_t> encodedBytes = reader.ReadBytes(encodedBytesSize);
+        if (tableType != NEW_TABLE && (tableType != REPEAT_TABLE || !hasTable)) {
+            throw std::runtime_error("Wrong HA table type");
         }
 
-        // read encoded string
-        uint64_t encodedStrLength = FileUtils::ReadValueBinary<uint64_t>(inputFile);
-        std::string encodedStr; encodedStr.reserve(encodedStrLength);
-        for (uint64_t j = 0; j < encodedStrLength - encodedStrLength % 8; j += 8) {
-            encodedStr += GetBinaryStringFromNumber(FileUtils::ReadValueBinary<uint8_t>(inputFile), 8);
+        size_t decodedSize = decodedRanks.size();
+        decodedRanks.resize(decodedSize + blockLength);
+
+        // the table is rebuilt only if it's changed
+        size_t tableStart = 4 * streamsCount;
+        if (encodedBytes.size() < tableStart) {
+            throw std::runtime_error("Wrong HA block");
         }
-        if (encodedStrLength % 8 != 0) {
-            encodedStr += GetBinaryStringFromNumber(FileUtils::ReadValueBinary<uint8_t>(inputFile), encodedStrLength % 8);
+        size_t tableSize = GetUint32(encodedBytes, 0);
+        if (tableSize > encodedBytes.size() - tableStart) {
+            throw std::runtime_error("Wrong HA table size");
+        }
+        if (tableType == NEW_TABLE) {
+            BitReader tableReader(encodedBytes.data() + tableStart, tableSize);
+            ReadCodeLengths(tableReader, codeLengths);
+            BuildHuffmanDecodingTable(codeLengths, decodingTable);
+            hasTable = true;
         }
 
-        // decode encoded string
-        std::u32string decodedStrLocal;
-        std::string currentCode; currentCode.reserve(8);
-        for (size_t j = 0; j < encodedStr.size(); ++j) {
-            currentCode.push_back(encodedStr[j]);
-            if (huffmanCodesMap.find(currentCode) != huffmanCodesMap.end()) {
-                decodedStrLocal.push_back(huffmanCodesMap[currentCode]);
-                currentCode.clear();
+        if (streamsCount == 1) {
+            BitReader reader(encodedBytes.data() + tableStart + tableSize, encodedBytes.size() - tableStart - tableSize);
+            for (uint64_t j = 0; j < blockLength; ++j) {
+                decodedRanks[decodedSize + j] = static_cast<rankType>(DecodeHuffmanSymbol(reader, decodingTable));
             }
+        } else {
+            DecodeStreams(encodedBytes, tableStart + tableSize, blockLength, decodingTable, &decodedRanks[decodedSize]);
         }
+    }
 
-        decodedStr += decodedStrLocal;
+    return decodedRanks;
+}
+
+std::string CodecHA::DecodeHA(BinaryReader& reader)
+{
+    AlphabetMap alphabetMap = AlphabetMap::Read(reader);
+    if (alphabetMap.GetSize() <= 256) {
+        std::vector<uint8_t> ranks = DecodeBlocks<uint8_t>(reader, alphabetMap.GetSize());
+        return alphabetMap.GetUTF8String(ranks.data(), ranks.size());
+    } else if (alphabetMap.GetSize() <= 65536) {
+        std::vector<uint16_t> ranks = DecodeBlocks<uint16_t>(reader, alphabetMap.GetSize());
+        return alphabetMap.GetUTF8String(ranks.data(), ranks.size());
     }
+    std::vector<uint32_t> ranks = DecodeBlocks<uint32_t>(reader, alphabetMap.GetSize());
+    return alphabetMap.GetUTF8String(ranks.data(), ranks.size());
+}
 
-    return decodedStr;
+template <typename rankType>
+void CodecHA::DecodeSymbols(BinaryReader& reader, const AlphabetMap& alphabetMap, std::u32string& output)
+{
+    std::vector<rankType> ranks = DecodeBlocks<rankType>(reader, alphabetMap.GetSize());
+    output.resize(ranks.size());
+    for (size_t i = 0; i < ranks.size(); ++i) {
+        output[i] = alphabetMap.GetAlphabet()[ranks[i]];
+    }
 }
 
-void CodecHA::Encode(const char* inputPath, const char* outputPath)
+void CodecHA::DecodeSymbols(BinaryReader& reader, std::u32string& output)
 {
-    FILE* outputFile = FileUtils::OpenFileBinaryWrite(outputPath);
+    AlphabetMap alphabetMap = AlphabetMap::Read(reader);
+    if (alphabetMap.GetSize() <= 256) {
+        DecodeSymbols<uint8_t>(reader, alphabetMap, output);
+    } else if (alphabetMap.GetSize() <= 65536) {
+        DecodeSymbols<uint16_t>(reader, alphabetMap, output);
+    } else {
+        DecodeSymbols<uint32_t>(reader, alphabetMap, output);
+    }
+}
 
-    data encodingData = GetData(FileUtils::ReadContentToU32String(inputPath));
+void CodecHA::EncodeSymbols(const std::u32string_view& input, BinaryWriter& writer)
+{
+    data encodingData = GetData(input);
     
-    FileUtils::AppendValueBinary(outputFile, static_cast<uint64_t>(encodingData.queueLocalData.size()));
+    encodingData.alphabetMap.Write(writer);
+    writer.WriteValue(static_cast<uint64_t>(encodingData.queueLocalData.size()));
     while (!encodingData.queueLocalData.empty()) {
-        data_local dataLocal = encodingData.queueLocalData.front();
+        const data_local& dataLocal = encodingData.queueLocalData.front();
 
-        FileUtils::AppendValueBinary(outputFile, dataLocal.alphabetLength);
-        CodecUTF8::EncodeString32ToBinaryFile(outputFile, dataLocal.alphabet);
-
-        std::map<char32_t, std::string> huffmanCodesMap = dataLocal.huffmanCodesMap;
-        // write lengths of huffman codes effectively
-        std::string lengthsOfCodes;
-        for (size_t i = 0; i < dataLocal.alphabetLength; ++i) {
-            lengthsOfCodes.push_back(huffmanCodesMap[dataLocal.alphabet[i]].size() + '0');
-        }
-        FileUtils::AppendSequenceOfDigitsBinary(outputFile, lengthsOfCodes);
-        // write huffman codes as a single string effectively
-        std::string allHuffmanCodes;
-        for (size_t i = 0; i < dataLocal.alphabetLength; ++i) {
-            allHuffmanCodes += huffmanCodesMap[dataLocal.alphabet[i]];
-        }
-        for (size_t i = 0; i < allHuffmanCodes.size() - allHuffmanCodes.size() % 8; i += 8) {
-            FileUtils::AppendValueBinary(outputFile, GetNumberFromBinaryString(allHuffmanCodes.substr(i, 8)));
-        }
-        if (allHuffmanCodes.size() % 8 != 0) {
-            FileUtils::AppendValueBinary(outputFile, static_cast<uint8_t>(GetNumberFromBinaryString(allHuffmanCodes.substr(allHuffmanCodes.size() - allHuffmanCodes.size() % 8))));
-        }
-        
-        // write encoded string effectively
-        std::string encodedStr = dataLocal.encodedStr;
-        FileUtils::AppendValueBinary(outputFile, static_cast<uint64_t>(encodedStr.size()));
-        for (size_t i = 0; i < encodedStr.size() - encodedStr.size() % 8; i += 8) {
-            FileUtils::AppendValueBinary(outputFile, GetNumberFromBinaryString(encodedStr.substr(i, 8)));
-        }
-        if (encodedStr.size() % 8 != 0) {
-            FileUtils::AppendValueBinary(outputFile, static_cast<uint8_t>(GetNumberFromBinaryString(encodedStr.substr(encodedStr.size() - encodedStr.size() % 8))));
-        }
+        writer.WriteValue(dataLocal.tableType);
+        writer.WriteValue(dataLocal.streamsCount);
+        writer.WriteValue(dataLocal.blockLength);
+        writer.WriteValue(static_cast<uint64_t>(dataLocal.encodedBytes.size()));
+        writer.WriteBytes(dataLocal.encodedBytes);
 
         encodingData.queueLocalData.pop();
     }
+}
+
+void CodecHA::Encode(const char* inputPath, const char* outputPath)
+{
+    FILE* outputFile = FileUtils::OpenFileBinaryWrite(outputPath);
+    BinaryWriter writer(outputFile);
 
+    EncodeSymbols(FileUtils::ReadContentToU32String(inputPath), writer);
+    writer.Flush();
     FileUtils::CloseFile(outputFile);
 }
 
 void CodecHA::Decode(const char* inputPath, const char* outputPath)
 {
     FILE* inputFile = FileUtils::OpenFileBinaryRead(inputPath);
+    BinaryReader reader(inputFile);
     std::ofstream outputFile = FileUtils::OpenFile<std::ofstream>(outputPath);
 
-    std::string decodedStr = CodecUTF8::EncodeString32ToString(DecodeHA(inputFile));
+    std::string decodedStr = DecodeHA(reader);
     FileUtils::AppendStr(outputFile, decodedStr);
 
     FileUtils::CloseFile(outputFile);
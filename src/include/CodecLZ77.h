@@ -0,0 +1,855 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <functional>
+
+#include "FileUtils.h"
+#include "BinaryStream.h"
+#include "IntegerArray.h"
+#include "ThreadUtils.h"
+#include "MappedFile.h"
+#include "BlockFile.h"
+#include "SuffixArray.h"
+
+// LZ77 over the bytes of the file
+class CodecLZ77
+{
+private:
+    CodecLZ77() = default;
+public:
+    // GREEDY_PARSING - hash chains and the longest match at every position (fast)
+    // LAZY_PARSING - the match is replaced with a literal if the next position has a longer match
+    // OPTIMAL_PARSING - binary tree of all the matches and the cheapest parsing (high ratio)
+    enum Level : uint8_t { GREEDY_PARSING = 1, LAZY_PARSING = 2, OPTIMAL_PARSING = 3 };
+    // frame size which is chosen by the parameters (see Parameters::frameSize)
+    static constexpr uint32_t AUTO_FRAME_SIZE = UINT32_MAX;
+    static constexpr uint32_t DEFAULT_FRAME_SIZE = 1 << 20;
+
+    struct Parameters {
+        uint32_t windowSize = 1 << 16; // maximum offset of the match
+        uint32_t chainDepth = 32; // maximum number of checked positions for every match
+        uint8_t level = LAZY_PARSING;
+        // matches are found by the suffix array: the longest previous match at any offset for every position
+        // (the slowest and the best for the high ratio, the window is the whole input)
+        bool useSuffixArray = false;
+        // maximum offset of long matches (at least LONG_DISTANCE_MIN_MATCH_LENGTH bytes)
+        // which are found by the sparse index before the parsing, 0 - no long distance matching
+        uint32_t longDistanceWindowSize = 0;
+        // the input is split into frames (0 - one frame) which are compressed by threadsCount threads.
+        // matches of a frame can't be longer than dictionarySize bytes before it, so the windows of long distance
+        // matching and of the suffix array are cut by frames: AUTO_FRAME_SIZE is one frame if any of them is used
+        // and DEFAULT_FRAME_SIZE otherwise
+        uint32_t frameSize = AUTO_FRAME_SIZE;
+        uint32_t threadsCount = 1;
+        // every frame can use this many last bytes of the previous frame as the dictionary
+        // (0 - frames are independent, so they are also decoded in parallel)
+        uint32_t dictionarySize = 1 << 16;
+        // backend of writing the compressed file (IO_URING falls back to PREAD_PWRITE if it isn't supported)
+        BlockFile::Backend ioBackend = BlockFile::PREAD_PWRITE;
+    };
+
+    static void Encode(const char* inputPath, const char* outputPath);
+    static void Encode(const char* inputPath, const char* outputPath, const Parameters& parameters);
+    static void Decode(const char* inputPath, const char* outputPath);
+    // ioBackend - backend of reading the compressed file
+    static void Decode(const char* inputPath, const char* outputPath, const BlockFile::Backend& ioBackend);
+protected:
+    static constexpr uint32_t MIN_MATCH_LENGTH = 4;
+    static constexpr uint32_t MAX_MATCH_LENGTH = 1 << 16;
+    static constexpr uint8_t HASH_BITS = 16;
+    // lazy parsing doesn't look for a longer match after the match of this length
+    static constexpr uint32_t MAX_LAZY_MATCH_LENGTH = 32;
+    // literals count and match length bigger than this are continued with varints after the sequence header
+    static constexpr uint8_t MAX_HEADER_VALUE = 15;
+    // optimal parsing: matches longer than NICE_MATCH_LENGTH are taken at once,
+    // the cheapest parsing is found for every OPTIMAL_BLOCK_LENGTH positions
+    static constexpr uint32_t NICE_MATCH_LENGTH = 256;
+    static constexpr size_t OPTIMAL_BLOCK_LENGTH = 1 << 12;
+    // matches are copied by COPY_BLOCK_SIZE bytes, so the decoded buffer has the slack after the end
+    static constexpr size_t COPY_BLOCK_SIZE = 16;
+    static constexpr size_t COPY_SLACK_SIZE = 2 * COPY_BLOCK_SIZE;
+    // long distance matching indexes every 2^LONG_DISTANCE_SAMPLING_BITS-th position on average
+    // (chosen by the rolling hash of LONG_DISTANCE_MIN_MATCH_LENGTH bytes)
+    static constexpr uint32_t LONG_DISTANCE_MIN_MATCH_LENGTH = 64;
+    static constexpr uint8_t LONG_DISTANCE_SAMPLING_BITS = 3;
+    static constexpr uint8_t LONG_DISTANCE_MAX_HASH_BITS = 22;
+    // frames are read, compressed and written at the same time,
+    // every thread has this many frames waiting for it (and for the writer)
+    static constexpr size_t PIPELINE_FRAMES_PER_THREAD = 2;
+
+    // frame of the encoded file, it starts at this position of the decoded string
+    struct frame {
+        uint64_t start;
+        uint64_t length;
+        uint64_t dictionarySize;
+        std::vector<uint8_t> bytes;
+    };
+    // length == 0 means the literal
+    struct token {
+        uint32_t offset;
+        uint32_t length;
+        uint8_t literal;
+        token(const uint32_t& _offset, const uint32_t& _length, const uint8_t& _literal) : offset(_offset), length(_length), literal(_literal) {}
+    };
+    struct data {
+        uint64_t strLength;
+        std::vector<token> tokens;
+        data(const uint64_t& _strLength, const std::vector<token>& _tokens) : strLength(_strLength), tokens(_tokens) {}
+    };
+    struct longDistanceMatch {
+        size_t position;
+        token match;
+        longDistanceMatch(const size_t& _position, const token& _match) : position(_position), match(_match) {}
+    };
+
+    // hash of the first MIN_MATCH_LENGTH bytes
+    static uint32_t GetHash(const std::string_view& inputStr, const size_t& position);
+    static size_t GetCyclicBufferSize(const uint32_t& windowSize, const size_t& inputSize);
+
+    // positions with the same hash are linked into chains
+    class HashChainMatchFinder {
+    public:
+        HashChainMatchFinder(const std::string_view& inputStr, const Parameters& parameters);
+        void Insert(const size_t& position);
+        // return the longest match for the position which ends before end (length 0 if it's not found)
+        // and insert the position
+        token FindLongestMatch(const size_t& position, const size_t& end);
+    private:
+        std::string_view inputStr;
+        uint32_t windowSize;
+        uint32_t chainDepth;
+        size_t chainMask;
+        std::vector<int64_t> head; // last position for every hash
+        std::vector<int64_t> chain; // previous position with the same hash (cyclic by the window)
+    };
+
+    // positions with the same hash form a binary search tree ordered by their suffixes,
+    // so one search finds the matches of all the lengths
+    class BinaryTreeMatchFinder {
+    public:
+        BinaryTreeMatchFinder(const std::string_view& inputStr, const Parameters& parameters);
+        // get matches with increasing lengths (not longer than NICE_MATCH_LENGTH) which end before end
+        // and insert the position
+        void GetMatches(const size_t& position, const size_t& end, std::vector<token>& matches);
+    private:
+        std::string_view inputStr;
+        uint32_t windowSize;
+        uint32_t cutValue; // maximum number of checked nodes
+        size_t treeMask;
+        std::vector<int64_t> head; // root of the tree for every hash
+        std::vector<int64_t> tree; // left and right children of every position (cyclic by the window)
+    };
+
+    // the longest previous factor of every position by the suffix array and LCP array
+    class SuffixArrayMatchFinder {
+    public:
+        SuffixArrayMatchFinder(const std::string_view& inputStr);
+        // all the positions are known in advance
+        void Insert(const size_t&) {}
+        token FindLongestMatch(const size_t& position, const size_t& end);
+        // the longest match not longer than NICE_MATCH_LENGTH (shorter lengths use the same offset)
+        void GetMatches(const size_t& position, const size_t& end, std::vector<token>& matches);
+    private:
+        std::vector<unsigned int> longestPreviousFactors;
+        std::vector<int> previousOccurrences;
+    };
+
+    // prices (in bits) of the tokens in the format of GetEncodedBytes
+    struct BytePriceModel {
+        uint32_t GetLiteralPrice(const uint8_t& literal) const;
+        uint32_t GetMatchPrice(const uint32_t& length, const uint32_t& offset) const;
+    };
+
+    // copy the match to destination, COPY_SLACK_SIZE bytes after the match can be overwritten
+    static void CopyMatch(char* destination, const size_t& offset, const size_t& length);
+
+    // rolling hash of the last 64 bytes: (hash << 1) + GEAR[byte]
+    static const std::vector<uint64_t>& GetGearTable();
+    // matches start after begin, the bytes before it are only indexed
+    static std::vector<longDistanceMatch> FindLongDistanceMatches(const std::string_view& inputStr, const size_t& begin, const uint32_t& windowSize);
+
+    // parsers of [begin, end) of the input
+    template <typename MatchFinder>
+    static void AppendGreedyTokens(const std::string_view& inputStr, const size_t& begin, const size_t& end,
+                                   MatchFinder& matchFinder, const bool& isLazy, std::vector<token>& tokens);
+    template <typename MatchFinder, typename PriceModel>
+    static void AppendOptimalTokens(const std::string_view& inputStr, const size_t& begin, const size_t& end,
+                                    MatchFinder& matchFinder, const PriceModel& priceModel, std::vector<token>& tokens);
+    // parsing of the level between long distance matches,
+    // the first dictionarySize bytes of the input are only inserted into match finders
+    template <typename PriceModel>
+    static std::vector<token> GetTokens(const std::string_view& inputStr, const size_t& dictionarySize, const Parameters& parameters, const PriceModel& priceModel);
+    static data GetData(const std::string_view& inputStr, const size_t& dictionarySize, const Parameters& parameters);
+    static std::vector<uint8_t> GetEncodedBytes(const data& encodingData);
+    static size_t GetFrameSize(const Parameters& parameters, const size_t& inputSize);
+    // decode the frame to output, matches can refer to dictionarySize bytes before output
+    static void DecodeFrame(const std::vector<uint8_t>& bytes, char* output, const size_t& dictionarySize, const size_t& length);
+    static void DecodeLZ77(BinaryReader& reader, const char* outputPath);
+};
+
+
+// START IMPLEMENTATION
+
+
+uint32_t CodecLZ77::GetHash(const std::string_view& inputStr, const size_t& position)
+{
+    uint32_t value = 0;
+    for (uint32_t i = 0; i < MIN_MATCH_LENGTH; ++i) {
+        value = (value << 8) | static_cast<uint8_t>(inputStr[position + i]);
+    }
+    return (value * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// cyclic buffers of match finders have the size of the power of 2 bigger than the window
+// (or not less than the input, then they are never overwritten)
+size_t CodecLZ77::GetCyclicBufferSize(const uint32_t& windowSize, const size_t& inputSize)
+{
+    size_t size = 1;
+    while (size <= windowSize && size < inputSize) {
+        size <<= 1;
+    }
+    return size;
+}
+
+// ==========================================================================================================
+
+CodecLZ77::HashChainMatchFinder::HashChainMatchFinder(const std::string_view& inputStr, const Parameters& parameters) :
+    inputStr(inputStr), windowSize(parameters.windowSize), chainDepth(parameters.chainDepth)
+{
+    size_t chainSize = GetCyclicBufferSize(windowSize, inputStr.size());
+    chainMask = chainSize - 1;
+    head.assign(size_t(1) << HASH_BITS, -1);
+    chain.assign(chainSize, -1);
+}
+
+void CodecLZ77::HashChainMatchFinder::Insert(const size_t& position)
+{
+    if (position + MIN_MATCH_LENGTH > inputStr.size()) {
+        return;
+    }
+    uint32_t hash = GetHash(inputStr, position);
+    chain[position & chainMask] = head[hash];
+    head[hash] = position;
+}
+
+CodecLZ77::token CodecLZ77::HashChainMatchFinder::FindLongestMatch(const size_t& position, const size_t& end)
+{
+    token bestMatch(0, 0, 0);
+    if (position + MIN_MATCH_LENGTH > end) {
+        Insert(position);
+        return bestMatch;
+    }
+
+    size_t maxLength = std::min<size_t>(MAX_MATCH_LENGTH, end - position);
+    int64_t candidate = head[GetHash(inputStr, position)];
+    for (uint32_t depth = 0; depth < chainDepth && candidate >= 0; ++depth) {
+        size_t offset = position - candidate;
+        if (offset > windowSize) {
+            break;
+        }
+        // check the byte after the best length first, most candidates fail on it
+        if (inputStr[candidate + bestMatch.length] == inputStr[position + bestMatch.length]) {
+            size_t length = 0;
+            while (length < maxLength && inputStr[candidate + length] == inputStr[position + length]) {
+                ++length;
+            }
+            if (length > bestMatch.length) {
+                bestMatch = token(offset, length, 0);
+                if (length == maxLength) {
+                    break;
+                }
+            }
+        }
+        candidate = chain[candidate & chainMask];
+    }
+
+    Insert(position);
+    if (bestMatch.length < MIN_MATCH_LENGTH) {
+        bestMatch.length = 0;
+    }
+    return bestMatch;
+}
+
+// ==========================================================================================================
+
+CodecLZ77::BinaryTreeMatchFinder::BinaryTreeMatchFinder(const std::string_view& inputStr, const Parameters& parameters) :
+    inputStr(inputStr), windowSize(parameters.windowSize), cutValue(parameters.chainDepth)
+{
+    size_t treeSize = GetCyclicBufferSize(windowSize, inputStr.size());
+    treeMask = treeSize - 1;
+    head.assign(size_t(1) << HASH_BITS, -1);
+    tree.assign(2 * treeSize, -1);
+}
+
+void CodecLZ77::BinaryTreeMatchFinder::GetMatches(const size_t& position, const size_t& end, std::vector<token>& matches)
+{
+    matches.clear();
+    if (position + MIN_MATCH_LENGTH > end) {
+        return;
+    }
+    size_t maxLength = std::min<size_t>(NICE_MATCH_LENGTH, end - position);
+
+    // the position becomes the root, the old tree is split into its left (smaller) and right (bigger) subtrees
+    uint32_t hash = GetHash(inputStr, position);
+    int64_t candidate = head[hash];
+    head[hash] = position;
+    int64_t* leftSlot = &tree[2 * (position & treeMask)];
+    int64_t* rightSlot = &tree[2 * (position & treeMask) + 1];
+    // all the nodes in the left (right) subtree have at least leftLength (rightLength) common bytes with the position
+    size_t leftLength = 0, rightLength = 0;
+    size_t bestLength = MIN_MATCH_LENGTH - 1;
+
+    for (uint32_t depth = 0; ; ++depth) {
+        if (candidate < 0 || depth == cutValue || position - candidate > windowSize) {
+            *leftSlot = -1;
+            *rightSlot = -1;
+            return;
+        }
+
+        int64_t* children = &tree[2 * (candidate & treeMask)];
+        size_t length = std::min(leftLength, rightLength);
+        while (length < maxLength && inputStr[candidate + length] == inputStr[position + length]) {
+            ++length;
+        }
+        if (length > bestLength) {
+            bestLength = length;
+            matches.push_back(token(position - candidate, length, 0));
+            if (length == maxLength) {
+                // the candidate is replaced with the position in the tree
+                *leftSlot = children[0];
+                *rightSlot = children[1];
+                return;
+            }
+        }
+
+        if (static_cast<uint8_t>(inputStr[candidate + length]) < static_cast<uint8_t>(inputStr[position + length])) {
+            *leftSlot = candidate;
+            leftSlot = &children[1];
+            candidate = *leftSlot;
+            leftLength = length;
+        } else {
+            *rightSlot = candidate;
+            rightSlot = &children[0];
+            candidate = *rightSlot;
+            rightLength = length;
+        }
+    }
+}
+
+// ==========================================================================================================
+
+CodecLZ77::SuffixArrayMatchFinder::SuffixArrayMatchFinder(const std::string_view& inputStr)
+{
+    std::vector<unsigned int> suffixArray = buildSuffixArray(inputStr);
+    std::vector<unsigned int> lcpArray = buildLCPArray(inputStr, suffixArray);
+    buildLongestPreviousFactors(suffixArray, lcpArray, longestPreviousFactors, previousOccurrences);
+}
+
+CodecLZ77::token CodecLZ77::SuffixArrayMatchFinder::FindLongestMatch(const size_t& position, const size_t& end)
+{
+    size_t length = std::min<size_t>({ longestPreviousFactors[position], MAX_MATCH_LENGTH, end - position });
+    if (length < MIN_MATCH_LENGTH) {
+        return token(0, 0, 0);
+    }
+    return token(position - previousOccurrences[position], length, 0);
+}
+
+void CodecLZ77::SuffixArrayMatchFinder::GetMatches(const size_t& position, const size_t& end, std::vector<token>& matches)
+{
+    matches.clear();
+    size_t length = std::min<size_t>({ longestPreviousFactors[position], NICE_MATCH_LENGTH, end - position });
+    if (length >= MIN_MATCH_LENGTH) {
+        matches.push_back(token(position - previousOccurrences[position], length, 0));
+    }
+}
+
+// ==========================================================================================================
+
+uint32_t CodecLZ77::BytePriceModel::GetLiteralPrice(const uint8_t&) const
+{
+    return 8;
+}
+
+// every match has the header of its sequence
+uint32_t CodecLZ77::BytePriceModel::GetMatchPrice(const uint32_t& length, const uint32_t& offset) const
+{
+    uint32_t price = 8 * (1 + IntegerArray::GetVarintSize(offset - 1));
+    if (length - MIN_MATCH_LENGTH >= MAX_HEADER_VALUE) {
+        price += 8 * IntegerArray::GetVarintSize(length - MIN_MATCH_LENGTH - MAX_HEADER_VALUE);
+    }
+    return price;
+}
+
+// ==========================================================================================================
+
+// short offsets are doubled by copying the pattern after itself until blocks don't overlap,
+// then the match is copied by whole blocks (memcpy of the constant size is a pair of unaligned vector moves)
+void CodecLZ77::CopyMatch(char* destination, const size_t& offset, const size_t& length)
+{
+    char* end = destination + length;
+    size_t blockOffset = offset;
+    while (blockOffset < COPY_BLOCK_SIZE) {
+        std::memcpy(destination, destination - blockOffset, blockOffset);
+        destination += blockOffset;
+        if (destination >= end) {
+            return;
+        }
+        blockOffset *= 2;
+    }
+    const char* source = destination - blockOffset;
+    while (destination < end) {
+        std::memcpy(destination, source, COPY_BLOCK_SIZE);
+        destination += COPY_BLOCK_SIZE;
+        source += COPY_BLOCK_SIZE;
+    }
+}
+
+// ==========================================================================================================
+
+// random numbers (splitmix64 with the fixed seed), encoder only
+const std::vector<uint64_t>& CodecLZ77::GetGearTable()
+{
+    static const std::vector<uint64_t> gearTable = []() {
+        std::vector<uint64_t> table(256);
+        uint64_t state = 0;
+        for (uint64_t& value : table) {
+            state += 0x9E3779B97F4A7C15ull;
+            value = state;
+            value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+            value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+            value ^= value >> 31;
+        }
+        return table;
+    }();
+    return gearTable;
+}
+
+// positions whose rolling hash has zero highest bits are indexed by the hash,
+// a candidate with the same hash is checked and the match is extended in both directions
+std::vector<CodecLZ77::longDistanceMatch> CodecLZ77::FindLongDistanceMatches(const std::string_view& inputStr, const size_t& begin, const uint32_t& windowSize)
+{
+    struct indexEntry {
+        int64_t position;
+        uint32_t checksum;
+    };
+
+    std::vector<longDistanceMatch> matches;
+    uint8_t hashBits = 1;
+    while (hashBits < LONG_DISTANCE_MAX_HASH_BITS && (size_t(1) << hashBits) < (inputStr.size() >> LONG_DISTANCE_SAMPLING_BITS)) {
+        ++hashBits;
+    }
+    std::vector<indexEntry> index(size_t(1) << hashBits, indexEntry{ -1, 0 });
+    const std::vector<uint64_t>& gearTable = GetGearTable();
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(inputStr.data());
+
+    uint64_t hash = 0;
+    size_t hashedCount = 0; // bytes in the hash after the last match
+    size_t lastMatchEnd = begin;
+    for (size_t i = 0; i < inputStr.size(); ++i) {
+        hash = (hash << 1) + gearTable[bytes[i]];
+        if (++hashedCount < LONG_DISTANCE_MIN_MATCH_LENGTH || (hash >> (64 - LONG_DISTANCE_SAMPLING_BITS)) != 0) {
+            continue;
+        }
+        size_t position = i + 1 - LONG_DISTANCE_MIN_MATCH_LENGTH;
+        uint32_t checksum = static_cast<uint32_t>(hash);
+        indexEntry& entry = index[(hash * 0x9E3779B97F4A7C15ull) >> (64 - hashBits)];
+        indexEntry candidate = entry;
+        entry = indexEntry{ static_cast<int64_t>(position), checksum };
+        if (position < begin || candidate.position < 0 || candidate.checksum != checksum || position - candidate.position > windowSize) {
+            continue;
+        }
+
+        size_t matchPosition = position, candidatePosition = candidate.position;
+        size_t length = 0;
+        while (matchPosition + length < inputStr.size() && length < MAX_MATCH_LENGTH &&
+               bytes[candidatePosition + length] == bytes[matchPosition + length]) {
+            ++length;
+        }
+        if (length < LONG_DISTANCE_MIN_MATCH_LENGTH) {
+            continue;
+        }
+        while (matchPosition > lastMatchEnd && candidatePosition > 0 && length < MAX_MATCH_LENGTH &&
+               bytes[candidatePosition - 1] == bytes[matchPosition - 1]) {
+            --matchPosition;
+            --candidatePosition;
+            ++length;
+        }
+        matches.push_back(longDistanceMatch(matchPosition, token(matchPosition - candidatePosition, length, 0)));
+
+        // the search restarts after the match
+        lastMatchEnd = matchPosition + length;
+        i = lastMatchEnd - 1;
+        hash = 0;
+        hashedCount = 0;
+    }
+
+    return matches;
+}
+
+// ==========================================================================================================
+
+template <typename MatchFinder>
+void CodecLZ77::AppendGreedyTokens(const std::string_view& inputStr, const size_t& begin, const size_t& end,
+                                   MatchFinder& matchFinder, const bool& isLazy, std::vector<token>& tokens)
+{
+    size_t stringPointer = begin;
+    while (stringPointer < end) {
+        token match = matchFinder.FindLongestMatch(stringPointer, end);
+        if (match.length == 0) {
+            tokens.push_back(token(0, 0, inputStr[stringPointer]));
+            ++stringPointer;
+            continue;
+        }
+
+        // the next position is already inserted by the lazy check
+        size_t insertedPointer = stringPointer + 1;
+        if (isLazy) {
+            while (match.length < MAX_LAZY_MATCH_LENGTH) {
+                token nextMatch = matchFinder.FindLongestMatch(stringPointer + 1, end);
+                insertedPointer = stringPointer + 2;
+                if (nextMatch.length <= match.length) {
+                    break;
+                }
+                tokens.push_back(token(0, 0, inputStr[stringPointer]));
+                ++stringPointer;
+                match = nextMatch;
+            }
+        }
+        tokens.push_back(match);
+        for (size_t i = insertedPointer; i < stringPointer + match.length; ++i) {
+            matchFinder.Insert(i);
+        }
+        stringPointer += match.length;
+    }
+}
+
+// the cheapest parsing by the prices of priceModel (dynamic programming over blocks of positions)
+template <typename MatchFinder, typename PriceModel>
+void CodecLZ77::AppendOptimalTokens(const std::string_view& inputStr, const size_t& begin, const size_t& end,
+                                    MatchFinder& matchFinder, const PriceModel& priceModel, std::vector<token>& tokens)
+{
+    const uint32_t INFINITE_PRICE = UINT32_MAX;
+
+    std::vector<token> matches;
+    // for every position of the block: the cheapest price to get there and the last token
+    std::vector<uint32_t> prices(OPTIMAL_BLOCK_LENGTH + NICE_MATCH_LENGTH + 1);
+    std::vector<token> lastTokens(OPTIMAL_BLOCK_LENGTH + NICE_MATCH_LENGTH + 1, token(0, 0, 0));
+
+    size_t blockStart = begin;
+    while (blockStart < end) {
+        size_t blockEnd = std::min(end, blockStart + OPTIMAL_BLOCK_LENGTH);
+        std::fill(prices.begin(), prices.end(), INFINITE_PRICE);
+        prices[0] = 0;
+        token longMatch(0, 0, 0);
+
+        size_t stringPointer = blockStart;
+        for (; stringPointer < blockEnd; ++stringPointer) {
+            size_t i = stringPointer - blockStart;
+            matchFinder.GetMatches(stringPointer, end, matches);
+
+            // take a long match at once (positions inside of it aren't inserted to the match finder)
+            if (!matches.empty() && matches.back().length == NICE_MATCH_LENGTH) {
+                longMatch = matches.back();
+                while (stringPointer + longMatch.length < end && longMatch.length < MAX_MATCH_LENGTH && 
+                       inputStr[stringPointer + longMatch.length] == inputStr[stringPointer + longMatch.length - longMatch.offset]) {
+                    ++longMatch.length;
+                }
+                break;
+            }
+
+            // literal
+            uint32_t price = prices[i] + priceModel.GetLiteralPrice(inputStr[stringPointer]);
+            if (price < prices[i + 1]) {
+                prices[i + 1] = price;
+                lastTokens[i + 1] = token(0, 0, inputStr[stringPointer]);
+            }
+            // matches of all the lengths (every length uses the shortest found match which isn't shorter)
+            uint32_t length = MIN_MATCH_LENGTH;
+            for (const token& match : matches) {
+                for (; length <= match.length; ++length) {
+                    price = prices[i] + priceModel.GetMatchPrice(length, match.offset);
+                    if (price < prices[i + length]) {
+                        prices[i + length] = price;
+                        lastTokens[i + length] = token(match.offset, length, 0);
+                    }
+                }
+            }
+        }
+
+        // restore the parsing from the end of the block
+        size_t tokensCount = tokens.size();
+        for (size_t i = stringPointer - blockStart; i > 0; i -= std::max<uint32_t>(1, lastTokens[i].length)) {
+            tokens.push_back(lastTokens[i]);
+        }
+        std::reverse(tokens.begin() + tokensCount, tokens.end());
+
+        if (longMatch.length > 0) {
+            tokens.push_back(longMatch);
+            stringPointer += longMatch.length;
+        }
+        blockStart = stringPointer;
+    }
+}
+
+template <typename PriceModel>
+std::vector<CodecLZ77::token> CodecLZ77::GetTokens(const std::string_view& inputStr, const size_t& dictionarySize, const Parameters& parameters, const PriceModel& priceModel)
+{
+    std::vector<longDistanceMatch> longMatches;
+    if (parameters.longDistanceWindowSize > 0) {
+        longMatches = FindLongDistanceMatches(inputStr, dictionarySize, parameters.longDistanceWindowSize);
+    }
+    // the rest of the input after the last long match
+    longMatches.push_back(longDistanceMatch(inputStr.size(), token(0, 0, 0)));
+
+    std::vector<token> tokens;
+    const bool isOptimal = (parameters.level == OPTIMAL_PARSING);
+    const bool isLazy = (parameters.level == LAZY_PARSING);
+    // parser of [begin, end) with the match finder of the parameters
+    std::function<void(const size_t&, const size_t&)> appendTokens;
+    std::unique_ptr<HashChainMatchFinder> hashChainMatchFinder;
+    std::unique_ptr<BinaryTreeMatchFinder> binaryTreeMatchFinder;
+    std::unique_ptr<SuffixArrayMatchFinder> suffixArrayMatchFinder;
+    if (parameters.useSuffixArray) {
+        suffixArrayMatchFinder.reset(new SuffixArrayMatchFinder(inputStr));
+        appendTokens = [&](const size_t& begin, const size_t& end) {
+            if (isOptimal) {
+                AppendOptimalTokens(inputStr, begin, end, *suffixArrayMatchFinder, priceModel, tokens);
+            } else {
+                AppendGreedyTokens(inputStr, begin, end, *suffixArrayMatchFinder, isLazy, tokens);
+            }
+        };
+    } else if (isOptimal) {
+        binaryTreeMatchFinder.reset(new BinaryTreeMatchFinder(inputStr, parameters));
+        std::vector<token> matches;
+        for (size_t i = 0; i < dictionarySize; ++i) {
+            binaryTreeMatchFinder->GetMatches(i, inputStr.size(), matches);
+        }
+        appendTokens = [&](const size_t& begin, const size_t& end) {
+            AppendOptimalTokens(inputStr, begin, end, *binaryTreeMatchFinder, priceModel, tokens);
+        };
+    } else {
+        hashChainMatchFinder.reset(new HashChainMatchFinder(inputStr, parameters));
+        for (size_t i = 0; i < dictionarySize; ++i) {
+            hashChainMatchFinder->Insert(i);
+        }
+        appendTokens = [&](const size_t& begin, const size_t& end) {
+            AppendGreedyTokens(inputStr, begin, end, *hashChainMatchFinder, isLazy, tokens);
+        };
+    }
+
+    size_t begin = dictionarySize;
+    for (const longDistanceMatch& longMatch : longMatches) {
+        appendTokens(begin, longMatch.position);
+        if (longMatch.match.length > 0) {
+            tokens.push_back(longMatch.match);
+        }
+        begin = longMatch.position + longMatch.match.length;
+    }
+
+    return tokens;
+}
+
+CodecLZ77::data CodecLZ77::GetData(const std::string_view& inputStr, const size_t& dictionarySize, const Parameters& parameters)
+{
+    return data(inputStr.size() - dictionarySize, GetTokens(inputStr, dictionarySize, parameters, BytePriceModel()));
+}
+
+// sequences of literals and the match:
+// header byte (4 bits of literals count and 4 bits of length - MIN_MATCH_LENGTH, 15 means that a varint follows),
+// [varint(literals count - 15)], literals, varint(offset - 1), [varint(length - MIN_MATCH_LENGTH - 15)]
+// the last sequence has no match
+std::vector<uint8_t> CodecLZ77::GetEncodedBytes(const data& encodingData)
+{
+    std::vector<uint8_t> bytes;
+    size_t literalsStart = 0;
+    for (size_t i = 0; i <= encodingData.tokens.size(); ++i) {
+        if (i < encodingData.tokens.size() && encodingData.tokens[i].length == 0) {
+            continue;
+        }
+        size_t literalsCount = i - literalsStart;
+        size_t lengthValue = (i < encodingData.tokens.size()) ? encodingData.tokens[i].length - MIN_MATCH_LENGTH : 0;
+
+        bytes.push_back((std::min<size_t>(literalsCount, MAX_HEADER_VALUE) << 4) | std::min<size_t>(lengthValue, MAX_HEADER_VALUE));
+        if (literalsCount >= MAX_HEADER_VALUE) {
+            IntegerArray::AppendVarint(bytes, literalsCount - MAX_HEADER_VALUE);
+        }
+        for (size_t j = literalsStart; j < i; ++j) {
+            bytes.push_back(encodingData.tokens[j].literal);
+        }
+        if (i < encodingData.tokens.size()) {
+            IntegerArray::AppendVarint(bytes, encodingData.tokens[i].offset - 1);
+            if (lengthValue >= MAX_HEADER_VALUE) {
+                IntegerArray::AppendVarint(bytes, lengthValue - MAX_HEADER_VALUE);
+            }
+        }
+        literalsStart = i + 1;
+    }
+    return bytes;
+}
+
+// matches which end closer than COPY_SLACK_SIZE to the end of the frame are copied byte by byte,
+// so the next frame can be decoded at the same time
+void CodecLZ77::DecodeFrame(const std::vector<uint8_t>& bytes, char* output, const size_t& dictionarySize, const size_t& length)
+{
+    size_t stringPointer = 0, bytesPointer = 0;
+    while (true) {
+        uint8_t header = bytes.at(bytesPointer++);
+        uint64_t literalsCount = header >> 4;
+        if (literalsCount == MAX_HEADER_VALUE) {
+            literalsCount += IntegerArray::ReadVarint(bytes, bytesPointer);
+        }
+        if (literalsCount > length - stringPointer || literalsCount > bytes.size() - bytesPointer) {
+            throw std::runtime_error("Wrong LZ77 literals");
+        }
+        std::copy(bytes.begin() + bytesPointer, bytes.begin() + bytesPointer + literalsCount, output + stringPointer);
+        bytesPointer += literalsCount;
+        stringPointer += literalsCount;
+        if (stringPointer == length) {
+            break;
+        }
+
+        uint64_t offset = IntegerArray::ReadVarint(bytes, bytesPointer) + 1;
+        uint64_t matchLength = header & 0x0F;
+        if (matchLength == MAX_HEADER_VALUE) {
+            matchLength += IntegerArray::ReadVarint(bytes, bytesPointer);
+        }
+        matchLength += MIN_MATCH_LENGTH;
+        if (offset > stringPointer + dictionarySize || matchLength > length - stringPointer) {
+            throw std::runtime_error("Wrong LZ77 match");
+        }
+        if (matchLength + COPY_SLACK_SIZE <= length - stringPointer) {
+            CopyMatch(output + stringPointer, offset, matchLength);
+        } else {
+            for (uint64_t j = stringPointer; j < stringPointer + matchLength; ++j) {
+                output[j] = output[j - offset];
+            }
+        }
+        stringPointer += matchLength;
+    }
+}
+
+// the reader thread reads the next frames while the previous ones are decoded in place to the mapped output file,
+// the frame which uses the previous one as the dictionary waits for it (independent frames are decoded in parallel)
+void CodecLZ77::DecodeLZ77(BinaryReader& reader, const char* outputPath)
+{
+    uint64_t strLength = reader.ReadValue<uint64_t>();
+    uint64_t framesCount = reader.ReadValue<uint64_t>();
+    if ((framesCount == 0) != (strLength == 0)) {
+        throw std::runtime_error("Wrong LZ77 frame");
+    }
+
+    MappedFile outputFile = MappedFile::OpenWrite(outputPath, strLength);
+    char* decodedStr = reinterpret_cast<char*>(outputFile.GetData());
+    uint64_t frameStart = 0;
+    std::vector<uint8_t> isDecoded(framesCount, 0);
+    bool isFailed = false;
+    std::mutex mutex;
+    std::condition_variable frameDecoded;
+    uint32_t threadsCount = ThreadUtils::GetHardwareThreadsCount();
+    ThreadUtils::RunPipeline(framesCount, threadsCount, PIPELINE_FRAMES_PER_THREAD * threadsCount, [&](const size_t& i) {
+        frame encodedFrame;
+        encodedFrame.start = frameStart;
+        encodedFrame.length = reader.ReadValue<uint64_t>();
+        encodedFrame.dictionarySize = reader.ReadValue<uint64_t>();
+        uint64_t encodedBytesSize = reader.ReadValue<uint64_t>();
+        encodedFrame.bytes = reader.ReadBytes(encodedBytesSize);
+        if (encodedFrame.length == 0 || encodedFrame.length > strLength - frameStart || encodedFrame.dictionarySize > frameStart) {
+            throw std::runtime_error("Wrong LZ77 frame");
+        }
+        frameStart += encodedFrame.length;
+        if (i + 1 == framesCount && frameStart != strLength) {
+            throw std::runtime_error("Wrong LZ77 frame");
+        }
+        return encodedFrame;
+    }, [&](const frame& encodedFrame, const size_t& i) {
+        if (encodedFrame.dictionarySize > 0) {
+            std::unique_lock<std::mutex> lock(mutex);
+            frameDecoded.wait(lock, [&]() { return isFailed || isDecoded[i - 1]; });
+            if (isFailed) {
+                throw std::runtime_error("Wrong LZ77 frame");
+            }
+        }
+        try {
+            DecodeFrame(encodedFrame.bytes, decodedStr + encodedFrame.start, encodedFrame.dictionarySize, encodedFrame.length);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            isFailed = true;
+            frameDecoded.notify_all();
+            throw;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        isDecoded[i] = 1;
+        frameDecoded.notify_all();
+    });
+    outputFile.Close();
+}
+
+// long matches are found in the whole input only if it's one frame
+size_t CodecLZ77::GetFrameSize(const Parameters& parameters, const size_t& inputSize)
+{
+    size_t frameSize = parameters.frameSize;
+    if (frameSize == AUTO_FRAME_SIZE) {
+        frameSize = (parameters.longDistanceWindowSize > 0 || parameters.useSuffixArray) ? 0 : DEFAULT_FRAME_SIZE;
+    }
+    return (frameSize > 0) ? frameSize : std::max<size_t>(1, inputSize);
+}
+
+void CodecLZ77::Encode(const char* inputPath, const char* outputPath)
+{
+    Encode(inputPath, outputPath, Parameters());
+}
+
+// every frame: frame length, dictionary size, size of encoded bytes and encoded bytes.
+// the reader thread reads the pages of the next frames and the writer thread writes the compressed ones
+// while the frames are compressed by parameters.threadsCount threads
+void CodecLZ77::Encode(const char* inputPath, const char* outputPath, const Parameters& parameters)
+{
+    BlockFile outputFile = BlockFile::OpenWrite(outputPath, parameters.ioBackend);
+    BinaryWriter writer(&outputFile);
+
+    MappedFile inputFile = MappedFile::OpenRead(inputPath);
+    std::string_view inputStr = inputFile.GetView();
+    size_t frameSize = GetFrameSize(parameters, inputStr.size());
+    size_t framesCount = (inputStr.size() + frameSize - 1) / frameSize;
+
+    writer.WriteValue(static_cast<uint64_t>(inputStr.size()));
+    writer.WriteValue(static_cast<uint64_t>(framesCount));
+    auto getDictionarySize = [&](const size_t& i) { return std::min<size_t>(i * frameSize, parameters.dictionarySize); };
+    auto getFrameLength = [&](const size_t& i) { return std::min(frameSize, inputStr.size() - i * frameSize); };
+    uint32_t threadsCount = std::max<uint32_t>(1, parameters.threadsCount);
+    ThreadUtils::RunPipeline(framesCount, threadsCount, PIPELINE_FRAMES_PER_THREAD * threadsCount, [&](const size_t& i) {
+        inputFile.Prefetch(i * frameSize, getFrameLength(i));
+        return inputStr.substr(i * frameSize - getDictionarySize(i), getDictionarySize(i) + getFrameLength(i));
+    }, [&](const std::string_view& frameStr, const size_t& i) {
+        return GetEncodedBytes(GetData(frameStr, getDictionarySize(i), parameters));
+    }, [&](const std::vector<uint8_t>& encodedBytes, const size_t& i) {
+        writer.WriteValue(static_cast<uint64_t>(getFrameLength(i)));
+        writer.WriteValue(static_cast<uint64_t>(getDictionarySize(i)));
+        writer.WriteValue(static_cast<uint64_t>(encodedBytes.size()));
+        writer.WriteBytes(encodedBytes);
+    });
+
+    writer.Flush();
+    outputFile.Close();
+}
+
+void CodecLZ77::Decode(const char* inputPath, const char* outputPath)
+{
+    Decode(inputPath, outputPath, BlockFile::PREAD_PWRITE);
+}
+
+void CodecLZ77::Decode(const char* inputPath, const char* outputPath, const BlockFile::Backend& ioBackend)
+{
+    BlockFile inputFile = BlockFile::OpenRead(inputPath, ioBackend);
+    BinaryReader reader(&inputFile);
+    DecodeLZ77(reader, outputPath);
+    inputFile.Close();
+}
+
+// END IMPLEMENTATION
@@ -0,0 +1,270 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <vector>
+
+#include "FileUtils.h"
+#include "BinaryStream.h"
+#include "HuffmanTree.h"
+#include "BitStream.h"
+#include "MappedFile.h"
+#include "CodecLZ77.h"
+
+/**
+ * LZ77 + Huffman (like Deflate)
+ * literals and match lengths share one alphabet, match offsets have another one,
+ * big values are split into buckets and extra bits, buckets are coded by canonical Huffman codes of every block
+*/
+class CodecLZ77HA : public CodecLZ77
+{
+private:
+    CodecLZ77HA() = default;
+public:
+    static void Encode(const char* inputPath, const char* outputPath);
+    static void Encode(const char* inputPath, const char* outputPath, const Parameters& parameters);
+    static void Decode(const char* inputPath, const char* outputPath);
+protected:
+    // literals are 0..255, then END_OF_BLOCK and buckets of match lengths
+    static constexpr uint32_t END_OF_BLOCK = 256;
+    static constexpr uint32_t FIRST_LENGTH_SYMBOL = 257;
+    static constexpr uint32_t LITERALS_LENGTHS_ALPHABET_SIZE = FIRST_LENGTH_SYMBOL + 32; // lengths up to 2^16
+    static constexpr uint32_t OFFSETS_ALPHABET_SIZE = 64; // offsets up to 2^32
+    static constexpr uint8_t MAX_CODE_LENGTH = 15;
+    static constexpr uint8_t CODE_LENGTH_BITS = 4;
+    static constexpr size_t BLOCK_TOKENS_COUNT = 1 << 16;
+
+    // values 0..3 are buckets themselves, bigger values are split by the highest bit and the next one,
+    // the rest bits are extra
+    static void GetBucket(const uint32_t& value, uint32_t& bucket, uint8_t& extraBitsCount);
+    static uint32_t GetBucketBase(const uint32_t& bucket, uint8_t& extraBitsCount);
+
+    // prices (in bits) of the tokens by code lengths of the previous parsing
+    struct HuffmanPriceModel {
+        std::vector<uint8_t> literalsLengthsCodeLengths;
+        std::vector<uint8_t> offsetsCodeLengths;
+        uint32_t GetLiteralPrice(const uint8_t& literal) const;
+        uint32_t GetMatchPrice(const uint32_t& length, const uint32_t& offset) const;
+    };
+
+    static void CountSymbols(const std::vector<token>& tokens, const size_t& begin, const size_t& end,
+                             std::vector<uint64_t>& literalsLengthsFrequencies, std::vector<uint64_t>& offsetsFrequencies);
+    static std::vector<token> GetTokens(const std::string_view& inputStr, const Parameters& parameters);
+    static void EncodeBlock(BitWriter& writer, const std::vector<token>& tokens, const size_t& begin, const size_t& end);
+    static void DecodeLZ77HA(BinaryReader& binaryReader, const char* outputPath);
+};
+
+
+// START IMPLEMENTATION
+
+
+void CodecLZ77HA::GetBucket(const uint32_t& value, uint32_t& bucket, uint8_t& extraBitsCount)
+{
+    if (value < 4) {
+        bucket = value;
+        extraBitsCount = 0;
+        return;
+    }
+    uint8_t highestBit = 0;
+    for (uint8_t shift = 16; shift > 0; shift >>= 1) {
+        if ((value >> (highestBit + shift)) != 0) {
+            highestBit += shift;
+        }
+    }
+    extraBitsCount = highestBit - 1;
+    bucket = 2 * highestBit + ((value >> extraBitsCount) & 1);
+}
+
+uint32_t CodecLZ77HA::GetBucketBase(const uint32_t& bucket, uint8_t& extraBitsCount)
+{
+    if (bucket < 4) {
+        extraBitsCount = 0;
+        return bucket;
+    }
+    extraBitsCount = bucket / 2 - 1;
+    return (2 | (bucket & 1)) << extraBitsCount;
+}
+
+// ==========================================================================================================
+
+uint32_t CodecLZ77HA::HuffmanPriceModel::GetLiteralPrice(const uint8_t& literal) const
+{
+    return literalsLengthsCodeLengths[literal];
+}
+
+uint32_t CodecLZ77HA::HuffmanPriceModel::GetMatchPrice(const uint32_t& length, const uint32_t& offset) const
+{
+    uint32_t lengthBucket, offsetBucket;
+    uint8_t lengthExtraBitsCount, offsetExtraBitsCount;
+    GetBucket(length - MIN_MATCH_LENGTH, lengthBucket, lengthExtraBitsCount);
+    GetBucket(offset - 1, offsetBucket, offsetExtraBitsCount);
+    return literalsLengthsCodeLengths[FIRST_LENGTH_SYMBOL + lengthBucket] + lengthExtraBitsCount +
+           offsetsCodeLengths[offsetBucket] + offsetExtraBitsCount;
+}
+
+// ==========================================================================================================
+
+void CodecLZ77HA::CountSymbols(const std::vector<token>& tokens, const size_t& begin, const size_t& end,
+                               std::vector<uint64_t>& literalsLengthsFrequencies, std::vector<uint64_t>& offsetsFrequencies)
+{
+    uint32_t bucket;
+    uint8_t extraBitsCount;
+    for (size_t i = begin; i < end; ++i) {
+        if (tokens[i].length == 0) {
+            ++literalsLengthsFrequencies[tokens[i].literal];
+        } else {
+            GetBucket(tokens[i].length - MIN_MATCH_LENGTH, bucket, extraBitsCount);
+            ++literalsLengthsFrequencies[FIRST_LENGTH_SYMBOL + bucket];
+            GetBucket(tokens[i].offset - 1, bucket, extraBitsCount);
+            ++offsetsFrequencies[bucket];
+        }
+    }
+    ++literalsLengthsFrequencies[END_OF_BLOCK];
+}
+
+// optimal parsing is priced by Huffman codes of the lazy parsing
+std::vector<CodecLZ77::token> CodecLZ77HA::GetTokens(const std::string_view& inputStr, const Parameters& parameters)
+{
+    if (parameters.level != OPTIMAL_PARSING) {
+        return CodecLZ77::GetTokens(inputStr, 0, parameters, BytePriceModel());
+    }
+
+    Parameters lazyParameters = parameters;
+    lazyParameters.level = LAZY_PARSING;
+    std::vector<token> lazyTokens = CodecLZ77::GetTokens(inputStr, 0, lazyParameters, BytePriceModel());
+    // every symbol gets a code, so any match has a price
+    std::vector<uint64_t> literalsLengthsFrequencies(LITERALS_LENGTHS_ALPHABET_SIZE, 1);
+    std::vector<uint64_t> offsetsFrequencies(OFFSETS_ALPHABET_SIZE, 1);
+    CountSymbols(lazyTokens, 0, lazyTokens.size(), literalsLengthsFrequencies, offsetsFrequencies);
+
+    HuffmanPriceModel priceModel;
+    priceModel.literalsLengthsCodeLengths = GetLengthLimitedCodeLengths(literalsLengthsFrequencies, MAX_CODE_LENGTH);
+    priceModel.offsetsCodeLengths = GetLengthLimitedCodeLengths(offsetsFrequencies, MAX_CODE_LENGTH);
+    return CodecLZ77::GetTokens(inputStr, 0, parameters, priceModel);
+}
+
+// code lengths of both alphabets, codes of the tokens and END_OF_BLOCK
+void CodecLZ77HA::EncodeBlock(BitWriter& writer, const std::vector<token>& tokens, const size_t& begin, const size_t& end)
+{
+    std::vector<uint64_t> literalsLengthsFrequencies(LITERALS_LENGTHS_ALPHABET_SIZE, 0);
+    std::vector<uint64_t> offsetsFrequencies(OFFSETS_ALPHABET_SIZE, 0);
+    CountSymbols(tokens, begin, end, literalsLengthsFrequencies, offsetsFrequencies);
+
+    std::vector<uint8_t> literalsLengthsCodeLengths = GetLengthLimitedCodeLengths(literalsLengthsFrequencies, MAX_CODE_LENGTH);
+    std::vector<uint8_t> offsetsCodeLengths = GetLengthLimitedCodeLengths(offsetsFrequencies, MAX_CODE_LENGTH);
+    for (const uint8_t& codeLength : literalsLengthsCodeLengths) {
+        writer.WriteBits(codeLength, CODE_LENGTH_BITS);
+    }
+    for (const uint8_t& codeLength : offsetsCodeLengths) {
+        writer.WriteBits(codeLength, CODE_LENGTH_BITS);
+    }
+    std::vector<uint32_t> literalsLengthsCodes = GetCanonicalCodes(literalsLengthsCodeLengths);
+    std::vector<uint32_t> offsetsCodes = GetCanonicalCodes(offsetsCodeLengths);
+
+    uint32_t bucket;
+    uint8_t extraBitsCount;
+    for (size_t i = begin; i < end; ++i) {
+        const token& t = tokens[i];
+        if (t.length == 0) {
+            writer.WriteBits(literalsLengthsCodes[t.literal], literalsLengthsCodeLengths[t.literal]);
+            continue;
+        }
+        uint32_t lengthValue = t.length - MIN_MATCH_LENGTH;
+        GetBucket(lengthValue, bucket, extraBitsCount);
+        writer.WriteBits(literalsLengthsCodes[FIRST_LENGTH_SYMBOL + bucket], literalsLengthsCodeLengths[FIRST_LENGTH_SYMBOL + bucket]);
+        writer.WriteBits(lengthValue, extraBitsCount);
+
+        uint32_t offsetValue = t.offset - 1;
+        GetBucket(offsetValue, bucket, extraBitsCount);
+        writer.WriteBits(offsetsCodes[bucket], offsetsCodeLengths[bucket]);
+        writer.WriteBits(offsetValue, extraBitsCount);
+    }
+    writer.WriteBits(literalsLengthsCodes[END_OF_BLOCK], literalsLengthsCodeLengths[END_OF_BLOCK]);
+}
+
+// the output file is mapped with the slack of wide copies, which is cut when it's closed
+void CodecLZ77HA::DecodeLZ77HA(BinaryReader& binaryReader, const char* outputPath)
+{
+    uint64_t strLength = binaryReader.ReadValue<uint64_t>();
+    BitReader reader = binaryReader.GetBitReader();
+
+    MappedFile outputFile = MappedFile::OpenWrite(outputPath, strLength + COPY_SLACK_SIZE);
+    char* decodedStr = reinterpret_cast<char*>(outputFile.GetData());
+    size_t stringPointer = 0;
+    std::vector<uint8_t> literalsLengthsCodeLengths(LITERALS_LENGTHS_ALPHABET_SIZE);
+    std::vector<uint8_t> offsetsCodeLengths(OFFSETS_ALPHABET_SIZE);
+    HuffmanDecodingTable literalsLengthsTable, offsetsTable;
+    while (stringPointer < strLength) {
+        for (uint8_t& codeLength : literalsLengthsCodeLengths) {
+            codeLength = reader.ReadBits(CODE_LENGTH_BITS);
+        }
+        for (uint8_t& codeLength : offsetsCodeLengths) {
+            codeLength = reader.ReadBits(CODE_LENGTH_BITS);
+        }
+        BuildHuffmanDecodingTable(literalsLengthsCodeLengths, literalsLengthsTable);
+        BuildHuffmanDecodingTable(offsetsCodeLengths, offsetsTable);
+
+        while (true) {
+            uint32_t symbol = DecodeHuffmanSymbol(reader, literalsLengthsTable);
+            if (symbol == END_OF_BLOCK) {
+                break;
+            }
+            if (symbol < END_OF_BLOCK) {
+                if (stringPointer == strLength) {
+                    throw std::runtime_error("Wrong LZ77HA literal");
+                }
+                decodedStr[stringPointer++] = static_cast<char>(symbol);
+                continue;
+            }
+
+            uint8_t extraBitsCount;
+            uint64_t length = GetBucketBase(symbol - FIRST_LENGTH_SYMBOL, extraBitsCount);
+            length += reader.ReadBits(extraBitsCount) + MIN_MATCH_LENGTH;
+            uint64_t offset = GetBucketBase(DecodeHuffmanSymbol(reader, offsetsTable), extraBitsCount);
+            offset += uint64_t(reader.ReadBits(extraBitsCount)) + 1;
+            if (offset > stringPointer || length > strLength - stringPointer) {
+                throw std::runtime_error("Wrong LZ77HA match");
+            }
+            CopyMatch(decodedStr + stringPointer, offset, length);
+            stringPointer += length;
+        }
+    }
+
+    outputFile.Shrink(strLength);
+    outputFile.Close();
+}
+
+void CodecLZ77HA::Encode(const char* inputPath, const char* outputPath)
+{
+    Encode(inputPath, outputPath, Parameters());
+}
+
+void CodecLZ77HA::Encode(const char* inputPath, const char* outputPath, const Parameters& parameters)
+{
+    FILE* outputFile = FileUtils::OpenFileBinaryWrite(outputPath);
+
+    MappedFile inputFile = MappedFile::OpenRead(inputPath);
+    std::string_view inputStr = inputFile.GetView();
+    std::vector<token> tokens = GetTokens(inputStr, parameters);
+    BinaryWriter binaryWriter(outputFile);
+    binaryWriter.WriteValue(static_cast<uint64_t>(inputStr.size()));
+    binaryWriter.Flush();
+    BitWriter writer(outputFile);
+    for (size_t begin = 0; begin < tokens.size(); begin += BLOCK_TOKENS_COUNT) {
+        EncodeBlock(writer, tokens, begin, std::min(tokens.size(), begin + BLOCK_TOKENS_COUNT));
+    }
+    writer.Flush();
+
+    FileUtils::CloseFile(outputFile);
+}
+
+void CodecLZ77HA::Decode(const char* inputPath, const char* outputPath)
+{
+    FILE* inputFile = FileUtils::OpenFileBinaryRead(inputPath);
+    BinaryReader binaryReader(inputFile);
+    DecodeLZ77HA(binaryReader, outputPath);
+    FileUtils::CloseFile(inputFile);
+}
+
+// END IMPLEMENTATION
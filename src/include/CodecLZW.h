@@ -0,0 +1,265 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+#include "FileUtils.h"
+#include "BinaryStream.h"
+#include "BitStream.h"
+#include "MappedFile.h"
+
+/**
+ * LZW over the bytes of the file
+ * codes 0..255 are bytes, CLEAR_CODE resets the dictionary, new strings get the next codes.
+ * codes are written with the width of the biggest code which the decoder can get at this moment
+*/
+class CodecLZW
+{
+private:
+    CodecLZW() = default;
+public:
+    struct Parameters {
+        uint32_t maxDictionarySize = 1 << 16; // number of codes (FIRST_CODE < size <= 2^MAX_CODE_WIDTH)
+        // full dictionary is reset (better for changing data) or frozen
+        bool resetWhenFull = true;
+    };
+
+    static void Encode(const char* inputPath, const char* outputPath);
+    static void Encode(const char* inputPath, const char* outputPath, const Parameters& parameters);
+    static void Decode(const char* inputPath, const char* outputPath);
+protected:
+    static constexpr uint32_t CLEAR_CODE = 256;
+    static constexpr uint32_t FIRST_CODE = 257;
+    static constexpr uint8_t MAX_CODE_WIDTH = 20;
+
+    // trie of the encoder: edges (code of the prefix, byte) -> code are kept in the hash table
+    class Dictionary {
+    public:
+        Dictionary(const uint32_t& maxSize);
+        // return the code of the prefix extended by the byte (UINT32_MAX if it's not in the dictionary)
+        uint32_t Find(const uint32_t& prefixCode, const uint8_t& byte) const;
+        // return false if the dictionary is full
+        bool Add(const uint32_t& prefixCode, const uint8_t& byte);
+        void Reset();
+    private:
+        struct edge {
+            uint32_t key; // (prefixCode << 8) | byte, UINT32_MAX if the cell is empty
+            uint32_t code;
+        };
+        size_t GetCell(const uint32_t& key) const;
+
+        uint32_t maxSize;
+        uint32_t nextCode;
+        size_t tableMask;
+        std::vector<edge> table;
+    };
+
+    // width of the code with this maximum value
+    static uint8_t GetCodeWidth(const uint32_t& maxCode);
+    static void CheckParameters(const Parameters& parameters);
+    static void DecodeLZW(BinaryReader& binaryReader, const char* outputPath);
+};
+
+
+// START IMPLEMENTATION
+
+
+CodecLZW::Dictionary::Dictionary(const uint32_t& maxSize) : maxSize(maxSize)
+{
+    // the table is at most half full
+    size_t tableSize = 1;
+    while (tableSize < 2 * size_t(maxSize)) {
+        tableSize <<= 1;
+    }
+    tableMask = tableSize - 1;
+    table.resize(tableSize);
+    Reset();
+}
+
+size_t CodecLZW::Dictionary::GetCell(const uint32_t& key) const
+{
+    size_t cell = (key * 2654435761u) & tableMask;
+    while (table[cell].key != key && table[cell].key != UINT32_MAX) {
+        cell = (cell + 1) & tableMask;
+    }
+    return cell;
+}
+
+uint32_t CodecLZW::Dictionary::Find(const uint32_t& prefixCode, const uint8_t& byte) const
+{
+    const edge& e = table[GetCell((prefixCode << 8) | byte)];
+    return (e.key == UINT32_MAX) ? UINT32_MAX : e.code;
+}
+
+bool CodecLZW::Dictionary::Add(const uint32_t& prefixCode, const uint8_t& byte)
+{
+    if (nextCode == maxSize) {
+        return false;
+    }
+    uint32_t key = (prefixCode << 8) | byte;
+    table[GetCell(key)] = edge{ key, nextCode++ };
+    return true;
+}
+
+void CodecLZW::Dictionary::Reset()
+{
+    std::fill(table.begin(), table.end(), edge{ UINT32_MAX, 0 });
+    nextCode = FIRST_CODE;
+}
+
+// ==========================================================================================================
+
+uint8_t CodecLZW::GetCodeWidth(const uint32_t& maxCode)
+{
+    uint8_t width = 1;
+    while ((maxCode >> width) != 0) {
+        ++width;
+    }
+    return width;
+}
+
+void CodecLZW::CheckParameters(const Parameters& parameters)
+{
+    if (parameters.maxDictionarySize <= FIRST_CODE || parameters.maxDictionarySize > (uint32_t(1) << MAX_CODE_WIDTH)) {
+        throw std::runtime_error("Wrong LZW dictionary size");
+    }
+}
+
+// decoder adds the string after every code except the first one after the reset,
+// the code can be the string which is added right now (previous string + its first byte).
+// strings are written to the mapped output file
+void CodecLZW::DecodeLZW(BinaryReader& binaryReader, const char* outputPath)
+{
+    uint64_t strLength = binaryReader.ReadValue<uint64_t>();
+    Parameters parameters;
+    parameters.maxDictionarySize = binaryReader.ReadValue<uint32_t>();
+    CheckParameters(parameters);
+    BitReader reader = binaryReader.GetBitReader();
+
+    // strings of the codes: the prefix code, the last byte, the first byte and the length
+    std::vector<uint32_t> prefixCodes(parameters.maxDictionarySize);
+    std::vector<uint8_t> lastBytes(parameters.maxDictionarySize), firstBytes(parameters.maxDictionarySize);
+    std::vector<uint32_t> lengths(parameters.maxDictionarySize);
+    for (uint32_t code = 0; code < CLEAR_CODE; ++code) {
+        lastBytes[code] = firstBytes[code] = static_cast<uint8_t>(code);
+        lengths[code] = 1;
+    }
+
+    MappedFile outputFile = MappedFile::OpenWrite(outputPath, strLength);
+    uint8_t* decodedStr = outputFile.GetData();
+    size_t stringPointer = 0;
+    uint32_t nextCode = FIRST_CODE;
+    uint32_t previousCode = CLEAR_CODE;
+    while (stringPointer < strLength) {
+        // nextCode can be read while it's added, nothing is added to the full dictionary
+        uint32_t code = reader.ReadBits(GetCodeWidth(std::min(nextCode, parameters.maxDictionarySize - 1)));
+        // zeros after the end of truncated data are valid codes
+        if (reader.IsPastEnd()) {
+            throw std::runtime_error("Unexpected end of binary input");
+        }
+        if (code == CLEAR_CODE) {
+            nextCode = FIRST_CODE;
+            previousCode = CLEAR_CODE;
+            continue;
+        }
+        // the new string can be used only if it's added right now
+        bool isAdded = (previousCode != CLEAR_CODE && nextCode < parameters.maxDictionarySize);
+        if (code > nextCode || (code == nextCode && !isAdded)) {
+            throw std::runtime_error("Wrong LZW code");
+        }
+
+        if (isAdded) {
+            // the first byte of the current string is known even if it's the new one
+            prefixCodes[nextCode] = previousCode;
+            firstBytes[nextCode] = firstBytes[previousCode];
+            lastBytes[nextCode] = firstBytes[(code == nextCode) ? previousCode : code];
+            lengths[nextCode] = lengths[previousCode] + 1;
+            ++nextCode;
+        }
+
+        // the string is written from the end
+        if (lengths[code] > strLength - stringPointer) {
+            throw std::runtime_error("Wrong LZW code");
+        }
+        stringPointer += lengths[code];
+        size_t pointer = stringPointer;
+        for (uint32_t c = code; lengths[c] > 1; c = prefixCodes[c]) {
+            decodedStr[--pointer] = lastBytes[c];
+        }
+        decodedStr[--pointer] = firstBytes[code];
+        previousCode = code;
+    }
+
+    outputFile.Close();
+}
+
+void CodecLZW::Encode(const char* inputPath, const char* outputPath)
+{
+    Encode(inputPath, outputPath, Parameters());
+}
+
+void CodecLZW::Encode(const char* inputPath, const char* outputPath, const Parameters& parameters)
+{
+    CheckParameters(parameters);
+    MappedFile inputFile = MappedFile::OpenRead(inputPath);
+    std::string_view inputStr = inputFile.GetView();
+    FILE* outputFile = FileUtils::OpenFileBinaryWrite(outputPath);
+    BinaryWriter binaryWriter(outputFile);
+    binaryWriter.WriteValue(static_cast<uint64_t>(inputStr.size()));
+    binaryWriter.WriteValue(parameters.maxDictionarySize);
+    binaryWriter.Flush();
+    BitWriter writer(outputFile);
+
+    Dictionary dictionary(parameters.maxDictionarySize);
+    // the code width follows the dictionary of the decoder, which is one string behind
+    uint32_t decoderNextCode = FIRST_CODE;
+    bool isFirstCode = true;
+    auto writeCode = [&](const uint32_t& code) {
+        writer.WriteBits(code, GetCodeWidth(std::min(decoderNextCode, parameters.maxDictionarySize - 1)));
+        if (code == CLEAR_CODE) {
+            decoderNextCode = FIRST_CODE;
+            isFirstCode = true;
+        } else {
+            if (!isFirstCode && decoderNextCode < parameters.maxDictionarySize) {
+                ++decoderNextCode;
+            }
+            isFirstCode = false;
+        }
+    };
+
+    if (!inputStr.empty()) {
+        uint32_t code = static_cast<uint8_t>(inputStr[0]);
+        for (size_t i = 1; i < inputStr.size(); ++i) {
+            uint8_t byte = static_cast<uint8_t>(inputStr[i]);
+            uint32_t nextCode = dictionary.Find(code, byte);
+            if (nextCode != UINT32_MAX) {
+                code = nextCode;
+                continue;
+            }
+            writeCode(code);
+            if (!dictionary.Add(code, byte) && parameters.resetWhenFull) {
+                writeCode(CLEAR_CODE);
+                dictionary.Reset();
+            }
+            code = byte;
+        }
+        writeCode(code);
+    }
+    writer.Flush();
+
+    FileUtils::CloseFile(outputFile);
+}
+
+void CodecLZW::Decode(const char* inputPath, const char* outputPath)
+{
+    FILE* inputFile = FileUtils::OpenFileBinaryRead(inputPath);
+    BinaryReader binaryReader(inputFile);
+    DecodeLZW(binaryReader, outputPath);
+    FileUtils::CloseFile(inputFile);
+}
+
+// END IMPLEMENTATION
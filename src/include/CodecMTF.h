@@ -1,14 +1,23 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <cstdint>
 #include <vector>
 #include <algorithm>
+#include <cstring>
+#include <stdexcept>
 
 #include "FileUtils.h"
+#include "BinaryStream.h"
 #include "CodecUTF8.h"
-#include "TextTools.h"
+#include "AlphabetMap.h"
+#include "IntegerArray.h"
 
+/**
+ * Move-to-front over the ranks of the sorted alphabet
+ * codes are uint8_t, uint16_t or uint32_t (by the size of the alphabet) and they are stored as an IntegerArray
+*/
 class CodecMTF
 {
 private:
@@ -16,135 +25,150 @@ private:
 public:
     static void Encode(const char* inputPath, const char* outputPath);
     static void Decode(const char* inputPath, const char* outputPath);
+
+    // stage of CodecPipeline: symbols are replaced with their codes, the alphabet is written to the header
+    static void EncodeSymbols(const std::u32string_view& input, std::u32string& output, BinaryWriter& header);
+    static void DecodeSymbols(const std::u32string_view& input, std::u32string& output, BinaryReader& header);
 protected:
-    struct data {
-        std::u32string alphabet;
-        uint64_t strLength;
-        std::vector<uint32_t> codes;
-        data(std::u32string _alphabet, uint64_t _strLength, std::vector<uint32_t> _codes) : alphabet(_alphabet), strLength(_strLength), codes(_codes) {}
-    };
-
-    template <typename valueType>
-    static void AlphabetShift(std::u32string& alphabet, const valueType& index);
-    static const uint32_t GetIndex(const std::u32string& alphabet, const char32_t c);
-    static data GetData(const std::u32string& inputStr);
-    static std::string DecodeMTF(FILE* inputFile);
+    // the list starts as the sorted alphabet, so ranks are the first positions of the characters
+    template <typename rankType>
+    static std::vector<rankType> MoveToFront(const std::vector<rankType>& ranks, const size_t& alphabetLength);
+    template <typename rankType>
+    static std::vector<rankType> MoveToFrontInverse(const std::vector<rankType>& codes, const size_t& alphabetLength);
+    template <typename rankType>
+    static std::string DecodeCodes(BinaryReader& reader, const AlphabetMap& alphabetMap);
+    template <typename rankType>
+    static void DecodeCodes(const std::u32string_view& input, const AlphabetMap& alphabetMap, std::u32string& output);
+    static std::string DecodeMTF(BinaryReader& reader);
 };
 
 
 // START IMPLEMENTATION
 
-template <typename valueType>
-void CodecMTF::AlphabetShift(std::u32string& alphabet, const valueType& index)
+template <typename rankType>
+std::vector<rankType> CodecMTF::MoveToFront(const std::vector<rankType>& ranks, const size_t& alphabetLength)
 {
-    char32_t temp = alphabet[0], temp2;
-    for (valueType i = 1; i <= index; ++i) {
-        temp2 = alphabet[i];
-        alphabet[i] = temp;
-        temp = temp2;
+    std::vector<rankType> list(alphabetLength);
+    for (size_t i = 0; i < alphabetLength; ++i) {
+        list[i] = static_cast<rankType>(i);
     }
-    alphabet[0] = temp;
-}
 
-const uint32_t CodecMTF::GetIndex(const std::u32string& alphabet, const char32_t c)
-{
-    for (size_t i = 0; i < alphabet.size(); ++i) {
-        if (alphabet[i] == c) {
-            return static_cast<uint32_t>(i);
+    std::vector<rankType> codes(ranks.size());
+    for (size_t i = 0; i < ranks.size(); ++i) {
+        // the list is shifted while the rank is searched
+        rankType rank = ranks[i], previous = list[0];
+        size_t index = 0;
+        while (previous != rank) {
+            std::swap(previous, list[++index]);
         }
+        list[0] = rank;
+        codes[i] = static_cast<rankType>(index);
     }
-    return 0; // assume that this will never happen
+    return codes;
 }
 
-CodecMTF::data CodecMTF::GetData(const std::u32string& inputStr)
+template <typename rankType>
+std::vector<rankType> CodecMTF::MoveToFrontInverse(const std::vector<rankType>& codes, const size_t& alphabetLength)
 {
-    std::u32string alphabet = GetAlphabet(inputStr);
-    uint64_t strLength = inputStr.size();
-
-    std::vector<uint32_t> codes; codes.reserve(strLength);
-    uint32_t index;
-    // move-to-front
-    for (uint64_t i = 0; i < strLength; ++i) {
-        index = GetIndex(alphabet, inputStr[i]);
-        codes.push_back(index);
-
-        AlphabetShift(alphabet, index);
+    std::vector<rankType> list(alphabetLength);
+    for (size_t i = 0; i < alphabetLength; ++i) {
+        list[i] = static_cast<rankType>(i);
     }
 
-    std::sort(alphabet.begin(), alphabet.end());
-    return data(alphabet, strLength, codes);
+    std::vector<rankType> ranks(codes.size());
+    for (size_t i = 0; i < codes.size(); ++i) {
+        rankType index = codes[i];
+        if (index >= alphabetLength) {
+            throw std::runtime_error("Wrong MTF code");
+        }
+        rankType rank = list[index];
+        std::memmove(list.data() + 1, list.data(), index * sizeof(rankType));
+        list[0] = rank;
+        ranks[i] = rank;
+    }
+    return ranks;
 }
 
-std::string CodecMTF::DecodeMTF(FILE* inputFile)
+template <typename rankType>
+std::string CodecMTF::DecodeCodes(BinaryReader& reader, const AlphabetMap& alphabetMap)
 {
-    uint32_t alphabetLength = FileUtils::ReadValueBinary<uint32_t>(inputFile);
-    std::u32string alphabet = CodecUTF8::DecodeString32FromBinaryFile(inputFile, alphabetLength);
-    uint64_t strLength = FileUtils::ReadValueBinary<uint64_t>(inputFile);
-
-    std::u32string decodedStr; decodedStr.reserve(strLength);
-    char32_t temp, temp2;
+    std::vector<rankType> codes = IntegerArray::Read<rankType>(reader);
+    std::vector<rankType> ranks = MoveToFrontInverse(codes, alphabetMap.GetSize());
+    return alphabetMap.GetUTF8String(ranks.data(), ranks.size());
+}
 
-    // decode
-    if (alphabetLength <= 256) {
-        uint8_t index;
-        for (uint64_t i = 0; i < strLength; ++i) {
-            index = FileUtils::ReadValueBinary<uint8_t>(inputFile);
-            decodedStr.push_back(alphabet[index]);
+std::string CodecMTF::DecodeMTF(BinaryReader& reader)
+{
+    AlphabetMap alphabetMap = AlphabetMap::Read(reader);
+    if (alphabetMap.GetSize() <= 256) {
+        return DecodeCodes<uint8_t>(reader, alphabetMap);
+    } else if (alphabetMap.GetSize() <= 65536) {
+        return DecodeCodes<uint16_t>(reader, alphabetMap);
+    }
+    return DecodeCodes<uint32_t>(reader, alphabetMap);
+}
 
-            AlphabetShift(alphabet, index);
+// codes are checked before they are narrowed to rankType
+template <typename rankType>
+void CodecMTF::DecodeCodes(const std::u32string_view& input, const AlphabetMap& alphabetMap, std::u32string& output)
+{
+    std::vector<rankType> codes(input.size());
+    for (size_t i = 0; i < input.size(); ++i) {
+        if (input[i] >= alphabetMap.GetSize()) {
+            throw std::runtime_error("Wrong MTF code");
         }
-    } else if (alphabetLength <= 65536) {
-        uint16_t index;
-        for (uint64_t i = 0; i < strLength; ++i) {
-            index = FileUtils::ReadValueBinary<uint16_t>(inputFile);
-            decodedStr.push_back(alphabet[index]);
+        codes[i] = static_cast<rankType>(input[i]);
+    }
+    std::vector<rankType> ranks = MoveToFrontInverse(codes, alphabetMap.GetSize());
+    output.resize(ranks.size());
+    for (size_t i = 0; i < ranks.size(); ++i) {
+        output[i] = alphabetMap.GetAlphabet()[ranks[i]];
+    }
+}
 
-            AlphabetShift(alphabet, index);
-        }
-    } else {
-        uint32_t index;
-        for (uint64_t i = 0; i < strLength; ++i) {
-            index = FileUtils::ReadValueBinary<uint32_t>(inputFile);
-            decodedStr.push_back(alphabet[index]);
+void CodecMTF::EncodeSymbols(const std::u32string_view& input, std::u32string& output, BinaryWriter& header)
+{
+    AlphabetMap alphabetMap(input);
+    alphabetMap.Write(header);
+    alphabetMap.VisitRanks(input, [&](const auto& ranks) {
+        auto codes = MoveToFront(ranks, alphabetMap.GetSize());
+        output.assign(codes.begin(), codes.end());
+    });
+}
 
-            AlphabetShift(alphabet, index);
-        }
+void CodecMTF::DecodeSymbols(const std::u32string_view& input, std::u32string& output, BinaryReader& header)
+{
+    AlphabetMap alphabetMap = AlphabetMap::Read(header);
+    if (alphabetMap.GetSize() <= 256) {
+        DecodeCodes<uint8_t>(input, alphabetMap, output);
+    } else if (alphabetMap.GetSize() <= 65536) {
+        DecodeCodes<uint16_t>(input, alphabetMap, output);
+    } else {
+        DecodeCodes<uint32_t>(input, alphabetMap, output);
     }
-
-    return CodecUTF8::EncodeString32ToString(decodedStr);
 }
 
 void CodecMTF::Encode(const char* inputPath, const char* outputPath)
 {
     FILE* outputFile = FileUtils::OpenFileBinaryWrite(outputPath);
-
-    data encodingData = GetData(FileUtils::ReadContentToU32String(inputPath));
-    FileUtils::AppendValueBinary(outputFile, static_cast<uint32_t>(encodingData.alphabet.size()));
-    CodecUTF8::EncodeString32ToBinaryFile(outputFile, encodingData.alphabet);
-    FileUtils::AppendValueBinary(outputFile, encodingData.strLength);
-
-    if (encodingData.alphabet.size() <= 256) {
-        for (uint64_t i = 0; i < encodingData.strLength; ++i) {
-            FileUtils::AppendValueBinary(outputFile, static_cast<uint8_t>(encodingData.codes[i]));
-        }
-    } else if (encodingData.alphabet.size() <= 65536) {
-        for (uint64_t i = 0; i < encodingData.strLength; ++i) {
-            FileUtils::AppendValueBinary(outputFile, static_cast<uint16_t>(encodingData.codes[i]));
-        }
-    } else {
-        for (uint64_t i = 0; i < encodingData.strLength; ++i) {
-            FileUtils::AppendValueBinary(outputFile, encodingData.codes[i]);
-        }
-    }
+    BinaryWriter writer(outputFile);
+
+    std::u32string inputStr = FileUtils::ReadContentToU32String(inputPath);
+    AlphabetMap alphabetMap(inputStr);
+    alphabetMap.Write(writer);
+    alphabetMap.VisitRanks(inputStr, [&](const auto& ranks) {
+        IntegerArray::Write(writer, MoveToFront(ranks, alphabetMap.GetSize()));
+    });
+    writer.Flush();
     FileUtils::CloseFile(outputFile);
 }
-
 void CodecMTF::Decode(const char* inputPath, const char* outputPath)
 {
     FILE* inputFile = FileUtils::OpenFileBinaryRead(inputPath);
+    BinaryReader reader(inputFile);
     std::ofstream outputFile = FileUtils::OpenFile<std::ofstream>(outputPath);
 
-    std::string decodedStr = DecodeMTF(inputFile);
+    std::string decodedStr = DecodeMTF(reader);
     FileUtils::AppendStr(outputFile, decodedStr);
 
     FileUtils::CloseFile(outputFile);
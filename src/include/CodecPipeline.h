@@ -0,0 +1,261 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <vector>
+#include <utility>
+#include <stdexcept>
+
+#include "FileUtils.h"
+#include "BinaryStream.h"
+#include "IntegerArray.h"
+#include "UTF8Decoder.h"
+#include "CodecUTF8.h"
+#include "CodecBWT.h"
+#include "CodecMTF.h"
+#include "CodecRLE.h"
+#include "CodecAC.h"
+#include "CodecHA.h"
+#include "FusedPipeline.h"
+
+/**
+ * Chain of codecs in memory (without intermediate files)
+ * the text goes through the stages as symbols (code points at the start): BWT, MTF and RLE transform them
+ * to other symbols, AC and HA encode them to bytes which are the symbols of the next stage.
+ * every stage writes its parameters to its header, the symbols after the last stage are stored as an IntegerArray.
+ * encoded: stages count (uint8_t), types of the stages (uint8_t), varint(size) and bytes of every header, symbols.
+ * two buffers of symbols are swapped between the stages, they and the encoding buffers of the headers
+ * and of the coders are kept for the next calls.
+ * MTF_ZR_HA is MTF, zero runs and Huffman coding fused in one loop (FusedPipeline)
+*/
+class CodecPipeline
+{
+public:
+    enum Stage : uint8_t { BWT = 0, MTF = 1, RLE = 2, AC = 3, HA = 4, MTF_ZR_HA = 5 };
+
+    explicit CodecPipeline(const std::vector<Stage>& stages);
+
+    void Encode(const std::string_view& inputStr, BinaryWriter& writer);
+    std::vector<uint8_t> Encode(const std::string_view& inputStr);
+    // the stages are read from the encoded bytes, so any pipeline decodes them
+    std::string Decode(BinaryReader& reader);
+    std::string Decode(const uint8_t* data, const size_t& size);
+
+    void Encode(const char* inputPath, const char* outputPath);
+    void Decode(const char* inputPath, const char* outputPath);
+protected:
+    // encode symbols with the stages
+    void EncodeSymbols(BinaryWriter& writer);
+    // decode the stages to symbols
+    void DecodeSymbols(BinaryReader& reader);
+    // interface of the stage: input symbols, output symbols (the buffer is overwritten), header of the stage
+    void EncodeStage(const Stage& stage, const std::u32string_view& input, std::u32string& output, BinaryWriter& header);
+    void DecodeStage(const Stage& stage, const std::u32string_view& input, std::u32string& output, BinaryReader& header);
+
+    std::vector<Stage> stages;
+    std::u32string symbols, stageSymbols;
+    // encoded bytes of the coders
+    BinaryWriter coderWriter;
+    std::vector<uint8_t> bytes;
+    // headers of the stages
+    std::vector<BinaryWriter> headerWriters;
+
+    using FusedMTF_ZR_HA = FusedPipeline<StageMTF, StageZeroRun, StageHuffman>;
+};
+
+// codec of the fixed chain of stages with the interface of the other codecs
+template <CodecPipeline::Stage... stages>
+class CodecChain
+{
+private:
+    CodecChain() = default;
+public:
+    static void Encode(const char* inputPath, const char* outputPath) { CodecPipeline({stages...}).Encode(inputPath, outputPath); }
+    static void Decode(const char* inputPath, const char* outputPath) { CodecPipeline({stages...}).Decode(inputPath, outputPath); }
+};
+
+// compressors of the task
+using CompressorHA = CodecChain<CodecPipeline::HA>;
+using CompressorAC = CodecChain<CodecPipeline::AC>;
+using CompressorRLE = CodecChain<CodecPipeline::RLE>;
+using CompressorBWT_RLE = CodecChain<CodecPipeline::BWT, CodecPipeline::RLE>;
+using CompressorBWT_MTF_HA = CodecChain<CodecPipeline::BWT, CodecPipeline::MTF, CodecPipeline::HA>;
+using CompressorBWT_MTF_AC = CodecChain<CodecPipeline::BWT, CodecPipeline::MTF, CodecPipeline::AC>;
+using CompressorBWT_MTF_RLE_HA = CodecChain<CodecPipeline::BWT, CodecPipeline::MTF, CodecPipeline::RLE, CodecPipeline::HA>;
+using CompressorBWT_MTF_RLE_AC = CodecChain<CodecPipeline::BWT, CodecPipeline::MTF, CodecPipeline::RLE, CodecPipeline::AC>;
+using CompressorBWT_MTF_ZR_HA = CodecChain<CodecPipeline::BWT, CodecPipeline::MTF_ZR_HA>;
+
+
+// START IMPLEMENTATION
+
+
+CodecPipeline::CodecPipeline(const std::vector<Stage>& stages) : stages(stages)
+{
+    if (stages.size() > UINT8_MAX) {
+        throw std::runtime_error("Too many pipeline stages");
+    }
+    for (const Stage& stage : stages) {
+        if (stage > MTF_ZR_HA) {
+            throw std::runtime_error("Wrong pipeline stage");
+        }
+    }
+}
+
+// headers are written after all the stages, so they are kept until the end
+void CodecPipeline::EncodeSymbols(BinaryWriter& writer)
+{
+    headerWriters.resize(stages.size());
+    for (size_t i = 0; i < stages.size(); ++i) {
+        headerWriters[i].Clear();
+        EncodeStage(stages[i], symbols, stageSymbols, headerWriters[i]);
+        std::swap(symbols, stageSymbols);
+    }
+
+    writer.WriteValue(static_cast<uint8_t>(stages.size()));
+    for (const Stage& stage : stages) {
+        writer.WriteValue(static_cast<uint8_t>(stage));
+    }
+    for (size_t i = 0; i < stages.size(); ++i) {
+        IntegerArray::WriteVarint(writer, headerWriters[i].GetSize());
+        writer.WriteBytes(headerWriters[i].GetData(), headerWriters[i].GetSize());
+    }
+    IntegerArray::Write(writer, symbols.data(), symbols.size());
+}
+
+void CodecPipeline::DecodeSymbols(BinaryReader& reader)
+{
+    std::vector<Stage> encodedStages(reader.ReadValue<uint8_t>());
+    for (Stage& stage : encodedStages) {
+        stage = static_cast<Stage>(reader.ReadValue<uint8_t>());
+        if (stage > MTF_ZR_HA) {
+            throw std::runtime_error("Wrong pipeline stage");
+        }
+    }
+    std::vector<std::vector<uint8_t>> headers(encodedStages.size());
+    for (std::vector<uint8_t>& header : headers) {
+        header = reader.ReadBytes(IntegerArray::ReadVarint(reader));
+    }
+    IntegerArray::Read(reader, symbols);
+
+    for (size_t i = encodedStages.size(); i > 0; --i) {
+        BinaryReader header(headers[i - 1].data(), headers[i - 1].size());
+        DecodeStage(encodedStages[i - 1], symbols, stageSymbols, header);
+        std::swap(symbols, stageSymbols);
+    }
+}
+
+// coders write bytes, they are widened to symbols
+void CodecPipeline::EncodeStage(const Stage& stage, const std::u32string_view& input, std::u32string& output, BinaryWriter& header)
+{
+    coderWriter.Clear();
+    switch (stage) {
+        case BWT:
+            CodecBWT::EncodeSymbols(input, output, header);
+            return;
+        case MTF:
+            CodecMTF::EncodeSymbols(input, output, header);
+            return;
+        case RLE:
+            CodecRLE::EncodeSymbols(input, output, header);
+            return;
+        case AC:
+            CodecAC::EncodeSymbols(input, coderWriter);
+            break;
+        case HA:
+            CodecHA::EncodeSymbols(input, coderWriter);
+            break;
+        case MTF_ZR_HA:
+            FusedMTF_ZR_HA::EncodeSymbols(input, coderWriter);
+            break;
+    }
+    output.assign(coderWriter.GetData(), coderWriter.GetData() + coderWriter.GetSize());
+}
+
+void CodecPipeline::DecodeStage(const Stage& stage, const std::u32string_view& input, std::u32string& output, BinaryReader& header)
+{
+    switch (stage) {
+        case BWT:
+            CodecBWT::DecodeSymbols(input, output, header);
+            return;
+        case MTF:
+            CodecMTF::DecodeSymbols(input, output, header);
+            return;
+        case RLE:
+            CodecRLE::DecodeSymbols(input, output, header);
+            return;
+        default:
+            break;
+    }
+
+    bytes.resize(input.size());
+    for (size_t i = 0; i < input.size(); ++i) {
+        if (input[i] > UINT8_MAX) {
+            throw std::runtime_error("Wrong pipeline byte");
+        }
+        bytes[i] = static_cast<uint8_t>(input[i]);
+    }
+    BinaryReader reader(bytes.data(), bytes.size());
+    if (stage == AC) {
+        CodecAC::DecodeSymbols(reader, output);
+    } else if (stage == HA) {
+        CodecHA::DecodeSymbols(reader, output);
+    } else {
+        FusedMTF_ZR_HA::DecodeSymbols(reader, output);
+    }
+}
+
+// ==========================================================================================================
+
+void CodecPipeline::Encode(const std::string_view& inputStr, BinaryWriter& writer)
+{
+    symbols.resize(inputStr.size());
+    symbols.resize(UTF8Decoder::Decode(reinterpret_cast<const uint8_t*>(inputStr.data()), inputStr.size(), &symbols[0]));
+    EncodeSymbols(writer);
+}
+
+std::vector<uint8_t> CodecPipeline::Encode(const std::string_view& inputStr)
+{
+    BinaryWriter writer;
+    Encode(inputStr, writer);
+    return std::vector<uint8_t>(writer.GetData(), writer.GetData() + writer.GetSize());
+}
+
+std::string CodecPipeline::Decode(BinaryReader& reader)
+{
+    DecodeSymbols(reader);
+    return CodecUTF8::EncodeString32ToString(symbols);
+}
+
+std::string CodecPipeline::Decode(const uint8_t* data, const size_t& size)
+{
+    BinaryReader reader(data, size);
+    return Decode(reader);
+}
+
+void CodecPipeline::Encode(const char* inputPath, const char* outputPath)
+{
+    FILE* outputFile = FileUtils::OpenFileBinaryWrite(outputPath);
+    BinaryWriter writer(outputFile);
+
+    symbols = FileUtils::ReadContentToU32String(inputPath);
+    EncodeSymbols(writer);
+
+    writer.Flush();
+    FileUtils::CloseFile(outputFile);
+}
+
+void CodecPipeline::Decode(const char* inputPath, const char* outputPath)
+{
+    FILE* inputFile = FileUtils::OpenFileBinaryRead(inputPath);
+    BinaryReader reader(inputFile);
+    std::ofstream outputFile = FileUtils::OpenFile<std::ofstream>(outputPath);
+
+    std::string decodedStr = Decode(reader);
+    FileUtils::AppendStr(outputFile, decodedStr);
+
+    FileUtils::CloseFile(outputFile);
+    FileUtils::CloseFile(inputFile);
+}
+
+// END IMPLEMENTATION
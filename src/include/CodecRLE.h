@@ -1,11 +1,14 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <cstdint>
 #include <queue>
 
 #include "FileUtils.h"
+#include "BinaryStream.h"
 #include "CodecUTF8.h"
+#include "IntegerArray.h"
 
 // Run-length encoding
 class CodecRLE
@@ -27,8 +30,16 @@ public:
     template <typename valueType>
     static data_numerical<valueType> GetDataNumerical(const std::vector<valueType>& inputNums);
     template <typename valueType>
-    static std::vector<valueType> DecodeRLENumerical(FILE* inputFile);
+    static std::vector<valueType> DecodeRLENumerical(BinaryReader& reader);
+
+    // stage of CodecPipeline: every count (as the symbol of its int8_t byte) is followed by the repeated symbol
+    // or by -count unique symbols like in the file, the number of symbols is written to the header
+    static void EncodeSymbols(const std::u32string_view& input, std::u32string& output, BinaryWriter& header);
+    static void DecodeSymbols(const std::u32string_view& input, std::u32string& output, BinaryReader& header);
 protected:
+    // maximum possible value of int8_t
+    static constexpr size_t MAX_SEQUENCE_LENGTH = 127;
+
     struct data {
         uint64_t strLength;
         std::queue<std::pair<int8_t, std::u32string>> encodedStr;
@@ -37,7 +48,7 @@ protected:
     
 
     static data GetData(const std::u32string& inputStr);
-    static std::string DecodeRLE(FILE* inputFile);
+    static std::string DecodeRLE(BinaryReader& reader);
 
     
 };
@@ -243,25 +254,25 @@ CodecRLE::data_numerical<valueType> CodecRLE::GetDataNumerical(const std::vector
     return data_numerical(inputNums.size(), encodedNums);
 }
 
-std::string CodecRLE::DecodeRLE(FILE* inputFile)
+std::string CodecRLE::DecodeRLE(BinaryReader& reader)
 {
     std::string decodedStr;
 
-    uint64_t strLength = FileUtils::ReadValueBinary<uint64_t>(inputFile);
+    uint64_t strLength = reader.ReadValue<uint64_t>();
     decodedStr.reserve(strLength);
 
     uint64_t counter = 0;
     int8_t number;
     while (counter < strLength)
     {
-        number = FileUtils::ReadValueBinary<int8_t>(inputFile);
+        number = reader.ReadValue<int8_t>();
 
         // if starts with negative number
         // (sequence of unqiue symbols)
         if (number < 0)
         {
             for (int8_t i = 0; i < (-number); ++i) {
-                decodedStr += CodecUTF8::DecodeChar32FromBinaryFileToString(inputFile);
+                decodedStr += CodecUTF8::DecodeChar32FromBinaryFileToString(reader);
                 ++counter;
             }
         }
@@ -269,7 +280,7 @@ std::string CodecRLE::DecodeRLE(FILE* inputFile)
         // (sequence of identical symbols)
         else
         {
-            std::string code = CodecUTF8::DecodeChar32FromBinaryFileToString(inputFile);
+            std::string code = CodecUTF8::DecodeChar32FromBinaryFileToString(reader);
 
             for (int8_t i = 0; i < number; ++i) {
                 decodedStr += code;
@@ -282,25 +293,25 @@ std::string CodecRLE::DecodeRLE(FILE* inputFile)
 }
 
 template <typename valueType>
-std::vector<valueType> CodecRLE::DecodeRLENumerical(FILE* inputFile)
+std::vector<valueType> CodecRLE::DecodeRLENumerical(BinaryReader& reader)
 {
     std::vector<valueType> decodedNums;
 
-    uint64_t numLength = FileUtils::ReadValueBinary<uint64_t>(inputFile);
+    uint64_t numLength = reader.ReadValue<uint64_t>();
     decodedNums.reserve(numLength);
 
     uint64_t counter = 0;
     int8_t number;
     while (counter < numLength)
     {
-        number = FileUtils::ReadValueBinary<int8_t>(inputFile);
+        number = reader.ReadValue<int8_t>();
 
         // if starts with negative number
         // (sequence of unqiue symbols)
         if (number < 0)
         {
             for (int8_t i = 0; i < (-number); ++i) {
-                decodedNums.push_back(FileUtils::ReadValueBinary<valueType>(inputFile));
+                decodedNums.push_back(reader.ReadValue<valueType>());
                 ++counter;
             }
         }
@@ -308,7 +319,7 @@ std::vector<valueType> CodecRLE::DecodeRLENumerical(FILE* inputFile)
         // (sequence of identical symbols)
         else
         {
-            valueType code = FileUtils::ReadValueBinary<valueType>(inputFile);
+            valueType code = reader.ReadValue<valueType>();
 
             for (int8_t i = 0; i < number; ++i) {
                 decodedNums.push_back(code);
@@ -320,28 +331,88 @@ std::vector<valueType> CodecRLE::DecodeRLENumerical(FILE* inputFile)
     return decodedNums;
 }
 
+// a sequence of identical symbols starts where the next symbol is the same
+void CodecRLE::EncodeSymbols(const std::u32string_view& input, std::u32string& output, BinaryWriter& header)
+{
+    IntegerArray::WriteVarint(header, input.size());
+    output.clear();
+    size_t pointer = 0;
+    while (pointer < input.size()) {
+        size_t length = 1;
+        while (pointer + length < input.size() && length < MAX_SEQUENCE_LENGTH && input[pointer + length] == input[pointer]) {
+            ++length;
+        }
+        if (length > 1) {
+            output.push_back(static_cast<char32_t>(length));
+            output.push_back(input[pointer]);
+            pointer += length;
+            continue;
+        }
+
+        length = 0;
+        while (pointer + length < input.size() && length < MAX_SEQUENCE_LENGTH &&
+               (pointer + length + 1 == input.size() || input[pointer + length + 1] != input[pointer + length])) {
+            ++length;
+        }
+        output.push_back(static_cast<char32_t>(static_cast<uint8_t>(-static_cast<int8_t>(length))));
+        output.append(input.substr(pointer, length));
+        pointer += length;
+    }
+}
+
+void CodecRLE::DecodeSymbols(const std::u32string_view& input, std::u32string& output, BinaryReader& header)
+{
+    uint64_t length = IntegerArray::ReadVarint(header);
+    output.clear();
+    output.reserve(std::min<uint64_t>(length, MAX_SEQUENCE_LENGTH * input.size()));
+    size_t pointer = 0;
+    while (pointer < input.size()) {
+        int8_t number = static_cast<int8_t>(input[pointer]);
+        if (input[pointer] > UINT8_MAX || number == 0) {
+            throw std::runtime_error("Wrong RLE sequence");
+        }
+        size_t count = (number < 0) ? -number : number;
+        size_t symbolsCount = (number < 0) ? count : 1;
+        if (input.size() - pointer - 1 < symbolsCount) {
+            throw std::runtime_error("Wrong RLE sequence");
+        }
+        if (number < 0) {
+            output.append(input.substr(pointer + 1, count));
+        } else {
+            output.append(count, input[pointer + 1]);
+        }
+        pointer += 1 + symbolsCount;
+    }
+    if (output.size() != length) {
+        throw std::runtime_error("Wrong RLE sequence");
+    }
+}
+
 void CodecRLE::Encode(const char* inputPath, const char* outputPath)
 {
     FILE* outputFile = FileUtils::OpenFileBinaryWrite(outputPath);
+    BinaryWriter writer(outputFile);
 
     data encodingData = GetData(FileUtils::ReadContentToU32String(inputPath));
-    FileUtils::AppendValueBinary(outputFile, encodingData.strLength);
+    writer.WriteValue(encodingData.strLength);
     while (!encodingData.encodedStr.empty()) {
         auto elem = encodingData.encodedStr.front();
-        FileUtils::AppendValueBinary(outputFile, elem.first);
-        CodecUTF8::EncodeString32ToBinaryFile(outputFile, elem.second);
+        writer.WriteValue(elem.first);
+        CodecUTF8::EncodeString32ToBinaryFile(writer, elem.second);
         encodingData.encodedStr.pop();
     }
 
+    writer.Flush();
     FileUtils::CloseFile(outputFile);
 }
 
 void CodecRLE::Decode(const char* inputPath, const char* outputPath)
 {
     FILE* inputFile = FileUtils::OpenFileBinaryRead(inputPath);
+    BinaryReader reader(inputFile);
     std::ofstream outputFile = FileUtils::OpenFile<std::ofstream>(outputPath);
 
-    std::string decodedStr = DecodeRLE(inputFile);
+    std::string decodedStr = DecodeRLE(reader);
     FileUtils::AppendStr(outputFile, decodedStr);
     
     FileUtils::CloseFile(outputFile);
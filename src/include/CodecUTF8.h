@@ -4,11 +4,14 @@
 #include <vector>
 #include <cstdint>
 #include "FileUtils.h"
+#include "UTF8Decoder.h"
+#include "BinaryStream.h"
 
 /**
  * UTF-8 codec
  * to encode strings of 4 byte characters to binary file with efficient memory usage
  * to decode binary file to those 4 byte strings 
+ * whole strings are converted in memory (ASCII by 16 characters), files are read and written by one call
 */
 class CodecUTF8 {
 public:
@@ -22,96 +25,144 @@ public:
     static std::string DecodeString32FromBinaryFileToString(FILE* file, const size_t& size);
     static std::string DecodeChar32FromBinaryFileToString(FILE* file);
 
+    // the same for buffered binary streams
+    static void EncodeString32ToBinaryFile(BinaryWriter& writer, const std::u32string& str);
+    static std::u32string DecodeString32FromBinaryFile(BinaryReader& reader, const size_t& size);
+    static std::string DecodeString32FromBinaryFileToString(BinaryReader& reader, const size_t& size);
+    static std::string DecodeChar32FromBinaryFileToString(BinaryReader& reader);
+
+    // encode size characters to output (it must have place for 4 * size bytes),
+    // return the number of bytes
+    static size_t EncodeString32ToBytes(const char32_t* str, const size_t& size, uint8_t* output);
+    // decode size characters from bytesSize bytes to output (throw if there are less characters),
+    // return the number of used bytes
+    static size_t DecodeString32FromBytes(const uint8_t* bytes, const size_t& bytesSize, const size_t& size, char32_t* output);
+
 private:
     CodecUTF8() = default;
     ~CodecUTF8() = default;
 
-    // base utf-8 encode function
-    static void EncodeChar32ToString(std::string& str, const char32_t& code_point);
+    static constexpr size_t MAX_CHAR_LENGTH = 4;
+    static constexpr size_t ASCII_BLOCK_SIZE = 16;
+
+    // base utf-8 encode function, return the number of bytes (0 for code points after U+10FFFF)
+    static size_t EncodeChar32ToBytes(uint8_t* output, const char32_t& code_point);
+    // length of the character by its first byte (0 if it can't be the first byte)
+    static size_t GetCharLength(const uint8_t& byte);
+    // read the bytes of size characters and decode them to output, return the bytes
+    static std::string ReadBytesOfString32(FILE* file, const size_t& size, char32_t* output);
+    static std::string ReadBytesOfString32(BinaryReader& reader, const size_t& size, char32_t* output);
 };
 
 // START IMPLEMENTATION
 
-void CodecUTF8::EncodeChar32ToString(std::string& str, const char32_t& code_point) {
+size_t CodecUTF8::EncodeChar32ToBytes(uint8_t* output, const char32_t& code_point) {
+    //Use uint8_t or unsigned char. Regular char may be signed
+    //and the sign bit may cause defect during bit manipulation
     if (code_point <= 0x007F) {
-        char ch = static_cast<char>(code_point);
-         
-        str.push_back(ch);
+        output[0] = static_cast<uint8_t>(code_point);
+        return 1;
     } else if (code_point <= 0x07FF) {
-        //Use uint8_t or unsigned char. Regular char may be signed
-        //and the sign bit may cause defect during bit manipulation
-        uint8_t b2 = 0b10000000 | (code_point & 0b111111);
-        uint8_t b1 = 0b11000000 | (code_point >> 6);
-         
-        str.push_back(b1);
-        str.push_back(b2);
+        output[0] = 0b11000000 | (code_point >> 6);
+        output[1] = 0b10000000 | (code_point & 0b111111);
+        return 2;
     } else if (code_point <= 0xFFFF) {
-        uint8_t b3 = 0b10000000 | (code_point & 0b111111);
-        uint8_t b2 = 0b10000000 | ((code_point >> 6) & 0b111111);
-        uint8_t b1 = 0b11100000 | (code_point >> 12);
-         
-        str.push_back(b1);
-        str.push_back(b2);
-        str.push_back(b3);
+        output[0] = 0b11100000 | (code_point >> 12);
+        output[1] = 0b10000000 | ((code_point >> 6) & 0b111111);
+        output[2] = 0b10000000 | (code_point & 0b111111);
+        return 3;
     } else if (code_point <= 0x10FFFF) {
-        uint8_t b4 = 0b10000000 | (code_point & 0b111111);
-        uint8_t b3 = 0b10000000 | ((code_point >> 6) & 0b111111);
-        uint8_t b2 = 0b10000000 | ((code_point >> 12) & 0b111111);
-        uint8_t b1 = 0b11110000 | (code_point >> 18);
-         
-        str.push_back(b1);
-        str.push_back(b2);
-        str.push_back(b3);
-        str.push_back(b4);
+        output[0] = 0b11110000 | (code_point >> 18);
+        output[1] = 0b10000000 | ((code_point >> 12) & 0b111111);
+        output[2] = 0b10000000 | ((code_point >> 6) & 0b111111);
+        output[3] = 0b10000000 | (code_point & 0b111111);
+        return 4;
+    }
+    return 0;
+}
+
+size_t CodecUTF8::GetCharLength(const uint8_t& byte)
+{
+    if ((byte & 0b10000000) == 0) {
+        return 1;
+    } else if ((byte & 0b11100000) == 0b11000000) {
+        return 2;
+    } else if ((byte & 0b11110000) == 0b11100000) {
+        return 3;
+    } else if ((byte & 0b11111000) == 0b11110000) {
+        return 4;
+    }
+    return 0;
+}
+
+size_t CodecUTF8::EncodeString32ToBytes(const char32_t* str, const size_t& size, uint8_t* output)
+{
+    size_t i = 0, length = 0;
+    while (i < size) {
+#ifdef UTF8_DECODER_SSE2
+        // blocks of ASCII are narrowed to bytes
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i notAscii = _mm_set1_epi32(~0x7F);
+        while (i + ASCII_BLOCK_SIZE <= size) {
+            const __m128i* source = reinterpret_cast<const __m128i*>(str + i);
+            __m128i a = _mm_loadu_si128(source), b = _mm_loadu_si128(source + 1);
+            __m128i c = _mm_loadu_si128(source + 2), d = _mm_loadu_si128(source + 3);
+            __m128i all = _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(all, notAscii), zero)) != 0xFFFF) {
+                break;
+            }
+            __m128i bytes = _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(output + length), bytes);
+            i += ASCII_BLOCK_SIZE;
+            length += ASCII_BLOCK_SIZE;
+        }
+        if (i == size) {
+            break;
+        }
+#endif
+        // 1 and 2-byte characters (Cyrillic, Greek, ...) with ASCII between them: both bytes are always written
+        while (i < size && str[i] <= 0x7FF) {
+            char32_t code_point = str[i++];
+            bool isTwoBytes = (code_point > 0x7F);
+            output[length] = static_cast<uint8_t>(isTwoBytes ? (0b11000000 | (code_point >> 6)) : code_point);
+            output[length + 1] = static_cast<uint8_t>(0b10000000 | (code_point & 0b111111));
+            length += isTwoBytes ? 2 : 1;
+            // go back to blocks after a long run of ASCII
+            if (!isTwoBytes && i + ASCII_BLOCK_SIZE <= size && str[i] <= 0x7F && str[i + 1] <= 0x7F) {
+                break;
+            }
+        }
+        if (i < size && str[i] > 0x7FF) {
+            length += EncodeChar32ToBytes(output + length, str[i++]);
+        }
     }
+    return length;
+}
+
+size_t CodecUTF8::DecodeString32FromBytes(const uint8_t* bytes, const size_t& bytesSize, const size_t& size, char32_t* output)
+{
+    return UTF8Decoder::DecodePrefix(bytes, bytesSize, size, output);
 }
 
 std::string CodecUTF8::EncodeString32ToString(const std::u32string& str)
 {
-    std::string result;
-    for (char32_t code : str) {
-        EncodeChar32ToString(result, code);
+    std::string result(MAX_CHAR_LENGTH * str.size(), '\0');
+    if (!str.empty()) {
+        result.resize(EncodeString32ToBytes(str.data(), str.size(), reinterpret_cast<uint8_t*>(&result[0])));
     }
     return result;
 }
 
 void CodecUTF8::EncodeChar32ToBinaryFile(FILE* file, const char32_t& code_point) {
-    if (code_point <= 0x007F) {
-        uint8_t ch = static_cast<uint8_t>(code_point);
-        FileUtils::AppendValueBinary(file, ch);
-    } else if (code_point <= 0x07FF) {
-        //Use uint8_t or unsigned char. Regular char may be signed
-        //and the sign bit may cause defect during bit manipulation
-        uint8_t b2 = 0b10000000 | (code_point & 0b111111);
-        uint8_t b1 = 0b11000000 | (code_point >> 6);
-
-        FileUtils::AppendValueBinary(file, b1);
-        FileUtils::AppendValueBinary(file, b2);
-    } else if (code_point <= 0xFFFF) {
-        uint8_t b3 = 0b10000000 | (code_point & 0b111111);
-        uint8_t b2 = 0b10000000 | ((code_point >> 6) & 0b111111);
-        uint8_t b1 = 0b11100000 | (code_point >> 12);
-         
-        FileUtils::AppendValueBinary(file, b1);
-        FileUtils::AppendValueBinary(file, b2);
-        FileUtils::AppendValueBinary(file, b3);
-    } else if (code_point <= 0x10FFFF) {
-        uint8_t b4 = 0b10000000 | (code_point & 0b111111);
-        uint8_t b3 = 0b10000000 | ((code_point >> 6) & 0b111111);
-        uint8_t b2 = 0b10000000 | ((code_point >> 12) & 0b111111);
-        uint8_t b1 = 0b11110000 | (code_point >> 18);
-        
-        FileUtils::AppendValueBinary(file, b1);
-        FileUtils::AppendValueBinary(file, b2);
-        FileUtils::AppendValueBinary(file, b3);
-        FileUtils::AppendValueBinary(file, b4);
+    uint8_t bytes[MAX_CHAR_LENGTH];
+    size_t length = EncodeChar32ToBytes(bytes, code_point);
+    if (length > 0) {
+        fwrite(bytes, 1, length, file);
     }
 }
 
 void CodecUTF8::EncodeString32ToBinaryFile(FILE* file, const std::u32string& str) {
-    for (size_t i = 0; i < str.size(); ++i) {
-        EncodeChar32ToBinaryFile(file, str[i]);
-    }
+    FileUtils::AppendStrBinary(file, EncodeString32ToString(str));
 }
 
 std::string CodecUTF8::DecodeChar32FromBinaryFileToString(FILE* file) {
@@ -123,13 +174,9 @@ std::string CodecUTF8::DecodeString32FromBinaryFileToString(FILE* file, const si
         return "";
     }
 
-    std::u32string result = DecodeString32FromBinaryFile(file, size);
-    std::string resultStr;
-    for (char32_t code : result) {
-        EncodeChar32ToString(resultStr, code);
-    }
- 
-    return resultStr;
+    // valid bytes are the same after decoding and encoding
+    std::vector<char32_t> decoded(size);
+    return ReadBytesOfString32(file, size, decoded.data());
 }
 
 std::u32string CodecUTF8::DecodeString32FromBinaryFile(FILE* file, const size_t& size)
@@ -138,93 +185,73 @@ std::u32string CodecUTF8::DecodeString32FromBinaryFile(FILE* file, const size_t&
         return U"";
     }
 
-    // result after decoding, which will be encoded to a char
-    std::u32string resultStr; 
-
-    //For unsigned bytes use uint8_t and not char.
-    //char may be signed in some platforms. Using
-    //char can actually introduce defects.
-    uint8_t bytes[] = {0, 0, 0, 0};
- 
-    // decode
-    for (size_t i = 0; i < size; ++i) {
-        bytes[0] = FileUtils::ReadValueBinary<uint8_t>(file);
-
-        if ((bytes[0] & 0b10000000) == 0) {
-            char32_t code = bytes[0];
-            resultStr.push_back(code);
-        } else if ((bytes[0] & 0b11100000) == 0b11000000) {
-            bytes[1] = FileUtils::ReadValueBinary<uint8_t>(file);
-
-            if ((bytes[1] & 0b11000000) != 0b10000000) {
-                //Error. Not a follow-on byte.
-                throw std::runtime_error("Can't decode byte in UTF-8");
-            }
-
-            //Clear the UTF-8 marker bits
-            bytes[0] = bytes[0] & 0b00011111;
-            bytes[1] = bytes[1] & 0b00111111;
-
-            char32_t code = (bytes[0] << 6) | bytes[1];
-
-            resultStr.push_back(code);
-        } else if ((bytes[0] & 0b11110000) == 0b11100000) {
-
-            bytes[1] = FileUtils::ReadValueBinary<uint8_t>(file);
-            bytes[2] = FileUtils::ReadValueBinary<uint8_t>(file);
-
-            if ((bytes[1] & 0b11000000) != 0b10000000) {
-                //Error. Not a follow-on byte.
-                throw std::runtime_error("Can't decode byte in UTF-8");
-            }
-
-            if ((bytes[2] & 0b11000000) != 0b10000000) {
-                //Error. Not a follow-on byte.
-                throw std::runtime_error("Can't decode byte in UTF-8");
-            }
+    std::u32string resultStr(size, U'\0');
+    ReadBytesOfString32(file, size, &resultStr[0]);
+    return resultStr;
+}
 
-            //Clear the UTF-8 marker bits
-            bytes[0] = bytes[0] & 0b00001111;
-            bytes[1] = bytes[1] & 0b00111111;
-            bytes[2] = bytes[2] & 0b00111111;
+// the bytes of size characters are read at once (at most 4 bytes per character),
+// the bytes after them are returned to the file
+std::string CodecUTF8::ReadBytesOfString32(FILE* file, const size_t& size, char32_t* output)
+{
+    std::string bytes(MAX_CHAR_LENGTH * size, '\0');
+    if (size == 1) {
+        // the length of one character is known after its first byte
+        size_t length = (fread(&bytes[0], 1, 1, file) == 1) ? GetCharLength(static_cast<uint8_t>(bytes[0])) : 0;
+        if (length == 0 || (length > 1 && fread(&bytes[1], 1, length - 1, file) != length - 1)) {
+            throw std::runtime_error("Can't decode byte in UTF-8");
+        }
+        bytes.resize(length);
+    } else {
+        bytes.resize(fread(&bytes[0], 1, bytes.size(), file));
+    }
 
-            char32_t code = (bytes[0] << 12) | (bytes[1] << 6) | bytes[2];
+    size_t usedBytes = DecodeString32FromBytes(reinterpret_cast<const uint8_t*>(bytes.data()), bytes.size(), size, output);
+    if (usedBytes < bytes.size()) {
+        fseek(file, -static_cast<long>(bytes.size() - usedBytes), SEEK_CUR);
+        bytes.resize(usedBytes);
+    }
+    return bytes;
+}
 
-            resultStr.push_back(code);
-        } else if ((bytes[0] & 0b11111000) == 0b11110000) {
-            bytes[1] = FileUtils::ReadValueBinary<uint8_t>(file);
-            bytes[2] = FileUtils::ReadValueBinary<uint8_t>(file);
-            bytes[3] = FileUtils::ReadValueBinary<uint8_t>(file);
+void CodecUTF8::EncodeString32ToBinaryFile(BinaryWriter& writer, const std::u32string& str) {
+    writer.WriteString(EncodeString32ToString(str));
+}
 
-            if ((bytes[1] & 0b11000000) != 0b10000000) {
-                //Error. Not a follow-on byte.
-                throw std::runtime_error("Can't decode byte in UTF-8");
-            } if ((bytes[2] & 0b11000000) != 0b10000000) {
-                //Error. Not a follow-on byte.
-                throw std::runtime_error("Can't decode byte in UTF-8");
-            } if ((bytes[3] & 0b11000000) != 0b10000000) {
-                //Error. Not a follow-on byte.
-                throw std::runtime_error("Can't decode byte in UTF-8");
-            }
+std::string CodecUTF8::DecodeChar32FromBinaryFileToString(BinaryReader& reader) {
+    return DecodeString32FromBinaryFileToString(reader, 1);
+}
 
-            //Clear the UTF-8 marker bits
-            bytes[0] = bytes[0] & 0b00000111;
-            bytes[1] = bytes[1] & 0b00111111;
-            bytes[2] = bytes[2] & 0b00111111;
-            bytes[3] = bytes[3] & 0b00111111;
+std::string CodecUTF8::DecodeString32FromBinaryFileToString(BinaryReader& reader, const size_t& size) {
+    if (size < 1) {
+        return "";
+    }
 
-            char32_t code = (bytes[0] << 18) | (bytes[1] << 12) | (bytes[2] << 6) | bytes[3];
+    std::vector<char32_t> decoded(size);
+    return ReadBytesOfString32(reader, size, decoded.data());
+}
 
-            resultStr.push_back(code);
-        } else {
-            //We can't decode this byte
-            throw std::runtime_error("Can't decode byte in UTF-8");
-        }
+std::u32string CodecUTF8::DecodeString32FromBinaryFile(BinaryReader& reader, const size_t& size)
+{
+    if (size == 0) {
+        return U"";
     }
 
+    std::u32string resultStr(size, U'\0');
+    ReadBytesOfString32(reader, size, &resultStr[0]);
     return resultStr;
 }
 
+// the buffer of the reader gets at most 4 bytes per character, only the used bytes are skipped
+std::string CodecUTF8::ReadBytesOfString32(BinaryReader& reader, const size_t& size, char32_t* output)
+{
+    size_t availableBytes = reader.Fill(MAX_CHAR_LENGTH * size);
+    size_t usedBytes = DecodeString32FromBytes(reader.GetPointer(), std::min(availableBytes, MAX_CHAR_LENGTH * size), size, output);
+    std::string bytes(reinterpret_cast<const char*>(reader.GetPointer()), usedBytes);
+    reader.Skip(usedBytes);
+    return bytes;
+}
+
 // END IMPLEMENTATION
 
 
@@ -5,9 +5,9 @@
 #include <cmath>
 #include <sstream>
 #include <cstdint>
-// for correct wide character reading
-#include <codecvt>
-#include <locale>
+#include <vector>
+
+#include "UTF8Decoder.h"
 
 class FileUtils
 {
@@ -36,10 +36,7 @@ public:
     static void AppendValueBinary(FILE* file, const valueType number);
     static const std::string ReadStrBinary(FILE* file, const size_t& size);
     static void AppendStrBinary(FILE* file, const std::string& str);
-
-    // complex functions
-    static void AppendSequenceOfDigitsBinary(FILE* file, const std::string& str);
-    static std::string ReadSequenceOfDigitsBinary(FILE* file, const size_t& size);
+    static const std::vector<uint8_t> ReadBytesBinary(FILE* file, const size_t& size);
 };
 
 // START IMPLEMENTATION
@@ -103,17 +100,18 @@ const std::string FileUtils::ReadContentToString(const char* filepath)
     return result;
 }
 
+// the file is read with a single call and decoded right to the string of the maximum size
 const std::u32string FileUtils::ReadContentToU32String(const char* filepath)
 {
-    std::ifstream file = FileUtils::OpenFile<std::ifstream>(filepath);
-    
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-
-    std::wstring_convert<std::codecvt_utf8<char32_t>, char32_t> converter;
-    std::u32string content = converter.from_bytes(buffer.str());
-    FileUtils::CloseFile(file);
+    FILE* file = OpenFileBinaryRead(filepath);
+    fseek(file, 0, SEEK_END);
+    long fileSize = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    std::vector<uint8_t> bytes = ReadBytesBinary(file, (fileSize > 0) ? static_cast<size_t>(fileSize) : 0);
+    CloseFile(file);
 
+    std::u32string content(bytes.size(), U'\0');
+    content.resize(UTF8Decoder::Decode(bytes.data(), bytes.size(), &content[0]));
     return content;
 }
 
@@ -163,104 +161,19 @@ const std::string FileUtils::ReadStrBinary(FILE* file, const size_t& size)
 
 void FileUtils::AppendStrBinary(FILE* file, const std::string& str)
 {
-    for (size_t i = 0; i < str.size(); ++i) {
-        AppendValueBinary(file, str[i]);
+    if (!str.empty()) {
+        fwrite(str.data(), 1, str.size(), file);
     }
 }
 
-// ==========================================================================================================
-
-void FileUtils::AppendSequenceOfDigitsBinary(FILE* file, const std::string& str)
+// read size bytes with a single call
+const std::vector<uint8_t> FileUtils::ReadBytesBinary(FILE* file, const size_t& size)
 {
-    size_t stringPointer = 0;
-
-    uint64_t ui64; // can store 19 digits
-    uint32_t ui32; // can store 9 digits
-    uint16_t ui16; // can store 4 digits
-    uint8_t ui8; // can store 2 digits
-    int8_t i8; // it will store 1 digit
-
-    while (stringPointer < str.size()) {
-        if ((str.size() - stringPointer) >= 19) {
-            ui64 = 0;
-            for (int i = 18; i >= 0; --i) {
-                ui64 += static_cast<uint64_t>(std::pow(10, i)) * (str[stringPointer++] - '0');
-            }
-            AppendValueBinary(file, ui64);
-        } else if ((str.size() - stringPointer) >= 9) {
-            ui32 = 0;
-            for (int i = 8; i >= 0; --i) {
-                ui32 += std::pow(10, i) * (str[stringPointer++] - '0');
-            }
-            AppendValueBinary(file, ui32);
-        } else if ((str.size() - stringPointer) >= 4) {
-            ui16 = 0;
-            for (int i = 3; i >= 0; --i) {
-                ui16 += std::pow(10, i) * (str[stringPointer++] - '0');
-            }
-            AppendValueBinary(file, ui16);
-        } else if ((str.size() - stringPointer) >= 2) {
-            ui8 = 0;
-            ui8 += 10 * (str[stringPointer++] - '0');
-            ui8 += 1 * (str[stringPointer++] - '0');
-            AppendValueBinary(file, ui8);
-        } else {
-            i8 = -1 * (str[stringPointer++] - '0');
-            AppendValueBinary(file, i8);
-        }
+    std::vector<uint8_t> bytes(size);
+    if (size > 0 && fread(bytes.data(), 1, size, file) != size) {
+        throw std::runtime_error("Failed to read " + std::to_string(size) + " bytes from file");
     }
-}
-
-std::string FileUtils::ReadSequenceOfDigitsBinary(FILE* file, const size_t& size)
-{
-    std::string str; str.reserve(size);
-    
-    size_t counter = size;
-
-    uint64_t ui64; // can store 19 digits
-    uint32_t ui32; // can store 9 digits
-    uint16_t ui16; // can store 4 digits
-    uint8_t ui8; // can store 2 digits
-    int8_t i8; // it will store 1 digit
-
-    while (counter > 0) {
-        if (counter >= 19) {
-            ui64 = ReadValueBinary<uint64_t>(file);
-            for (int i = 18; i >= 0; --i) {
-                int k = ui64 / static_cast<uint64_t>(std::pow(10, i));
-                str.push_back('0' + k);
-                ui64 -= k * static_cast<uint64_t>(std::pow(10, i));
-            }
-            counter -= 19;
-        } else if (counter >= 9) {
-            ui32 = ReadValueBinary<uint32_t>(file);
-            for (int i = 8; i >= 0; --i) {
-                int k = static_cast<int>(ui32 / std::pow(10, i));
-                str.push_back('0' + k);
-                ui32 -= k * std::pow(10, i);
-            }
-            counter -= 9;
-        } else if (counter >= 4) {
-            ui16 = ReadValueBinary<uint16_t>(file);
-            for (int i = 3; i >= 0; --i) {
-                int k = static_cast<int>(ui16 / std::pow(10, i));
-                str.push_back('0' + k);
-                ui16 -= k * std::pow(10, i);
-            }
-            counter -= 4;
-        } else if (counter >= 2) {
-            ui8 = ReadValueBinary<uint8_t>(file);
-            str.push_back('0' + ui8 / 10);
-            str.push_back('0' + ui8 % 10);
-            counter -= 2;
-        } else {
-            i8 = ReadValueBinary<int8_t>(file);
-            str.push_back('0' + (-1 * i8));
-            counter -= 1;
-        }
-    }
-
-    return str;
+    return bytes;
 }
 
 // ==========================================================================================================
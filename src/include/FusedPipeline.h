@@ -0,0 +1,375 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+#include "BinaryStream.h"
+#include "BitStream.h"
+#include "HuffmanTree.h"
+#include "AlphabetMap.h"
+#include "IntegerArray.h"
+
+/**
+ * Stages of FusedPipeline which take symbols one by one
+ * a stage is built by the size of its input alphabet (symbols are 0..size-1) and gives the size of its output one.
+ * Push(symbol, next) encodes the symbol and gives the results to next.Push, Finish(next) flushes the state.
+ * PushInverse(symbol, next) and FinishInverse(next) do the same while decoding
+*/
+
+// move-to-front over the ranks (the same codes as CodecMTF)
+class StageMTF
+{
+public:
+    explicit StageMTF(const uint32_t& alphabetSize);
+    uint32_t GetOutputSize() const { return static_cast<uint32_t>(list.size()); }
+
+    template <typename nextType>
+    void Push(const uint32_t& symbol, nextType& next);
+    template <typename nextType>
+    void Finish(nextType&) {}
+    template <typename nextType>
+    void PushInverse(const uint32_t& symbol, nextType& next);
+    template <typename nextType>
+    void FinishInverse(nextType&) {}
+private:
+    std::vector<uint32_t> list;
+};
+
+// runs of zeros are written as their lengths in bijective base 2 with digits RUN_A (1) and RUN_B (2),
+// the rest symbols are shifted by one (like in bzip2)
+class StageZeroRun
+{
+public:
+    explicit StageZeroRun(const uint32_t& alphabetSize) : alphabetSize(alphabetSize) {}
+    uint32_t GetOutputSize() const { return alphabetSize + 1; }
+
+    template <typename nextType>
+    void Push(const uint32_t& symbol, nextType& next);
+    template <typename nextType>
+    void Finish(nextType& next);
+    template <typename nextType>
+    void PushInverse(const uint32_t& symbol, nextType& next);
+    template <typename nextType>
+    void FinishInverse(nextType& next);
+private:
+    static constexpr uint32_t RUN_A = 0;
+    static constexpr uint32_t RUN_B = 1;
+    static constexpr uint8_t MAX_RUN_DIGITS = 63;
+
+    uint32_t alphabetSize;
+    uint64_t runLength = 0;
+    // next digit of the decoded run
+    uint8_t runDigit = 0;
+};
+
+// the last stage: one canonical Huffman table for all the symbols
+// symbols are kept until Write, because codes depend on the counts of all of them.
+// only MAX_CODED_SYMBOLS most frequent symbols (with ESCAPE) have codes, the rest are written after ESCAPE
+// as raw numbers, so the codes fit into MAX_CODE_LENGTH bits for any alphabet.
+// encoded: varint(symbols count), varint(bytes count), bytes (4 bits of every code length, codes)
+class StageHuffman
+{
+public:
+    // ESCAPE is the symbol after the alphabet
+    explicit StageHuffman(const uint32_t& alphabetSize) : escape(alphabetSize), counts(alphabetSize + 1, 0) {}
+
+    void Push(const uint32_t& symbol) {
+        ++counts[symbol];
+        symbols.push_back(symbol);
+    }
+    void Write(BinaryWriter& writer);
+    // decode all the symbols and give them to next.Push
+    template <typename nextType>
+    void Read(BinaryReader& reader, nextType& next);
+private:
+    static constexpr uint8_t MAX_CODE_LENGTH = 15;
+    static constexpr uint8_t CODE_LENGTH_BITS = 4;
+    static constexpr size_t MAX_CODED_SYMBOLS = size_t(1) << MAX_CODE_LENGTH;
+
+    // width of the raw symbols
+    uint8_t GetRawSymbolBits() const;
+
+    uint32_t escape;
+    std::vector<uint64_t> counts;
+    std::vector<uint32_t> symbols;
+};
+
+/**
+ * Pipeline of stages fused at compile time: FusedPipeline<StageMTF, StageZeroRun, StageHuffman>
+ * characters are replaced with their ranks and pushed through the stages one by one, all the calls are inlined
+ * into one loop over the input, so the symbols between the stages stay in registers instead of buffers.
+ * decoding goes back: the last stage decodes its symbols and pushes them through the inverse stages.
+ * encoded: alphabet (AlphabetMap), varint(characters count), data of the last stage
+*/
+template <typename... stageTypes>
+class FusedPipeline
+{
+private:
+    FusedPipeline() = default;
+public:
+    // stage of CodecPipeline (like the coders)
+    static void EncodeSymbols(const std::u32string_view& input, BinaryWriter& writer);
+    static void DecodeSymbols(BinaryReader& reader, std::u32string& output);
+protected:
+    template <typename... chainTypes>
+    struct chain;
+
+    // the last stage keeps the symbols
+    template <typename lastType>
+    struct chain<lastType>
+    {
+        lastType stage;
+        explicit chain(const uint32_t& alphabetSize) : stage(alphabetSize) {}
+        void Push(const uint32_t& symbol) { stage.Push(symbol); }
+        void Finish(BinaryWriter& writer) { stage.Write(writer); }
+        template <typename outputType>
+        void Read(BinaryReader& reader, outputType& output) { stage.Read(reader, output); }
+    };
+
+    // stage which pushes its symbols to the rest of the chain
+    template <typename stageType, typename... nextTypes>
+    struct chain<stageType, nextTypes...>
+    {
+        stageType stage;
+        chain<nextTypes...> next;
+        explicit chain(const uint32_t& alphabetSize) : stage(alphabetSize), next(stage.GetOutputSize()) {}
+        void Push(const uint32_t& symbol) { stage.Push(symbol, next); }
+        void Finish(BinaryWriter& writer) {
+            stage.Finish(next);
+            next.Finish(writer);
+        }
+        // symbols decoded by the rest of the chain go through the inverse of this stage to the output
+        template <typename outputType>
+        void Read(BinaryReader& reader, outputType& output) {
+            inverse<stageType, outputType> inverseStage{stage, output};
+            next.Read(reader, inverseStage);
+            stage.FinishInverse(output);
+        }
+    };
+
+    template <typename stageType, typename outputType>
+    struct inverse
+    {
+        stageType& stage;
+        outputType& output;
+        void Push(const uint32_t& symbol) { stage.PushInverse(symbol, output); }
+    };
+
+    // decoded ranks are replaced with the characters (at most length of them)
+    struct characters
+    {
+        const std::u32string& alphabet;
+        std::u32string& output;
+        size_t length;
+        void Push(const uint32_t& rank) {
+            if (output.size() == length) {
+                throw std::runtime_error("Wrong fused pipeline data");
+            }
+            output.push_back(alphabet[rank]);
+        }
+    };
+};
+
+
+// START IMPLEMENTATION
+
+
+StageMTF::StageMTF(const uint32_t& alphabetSize) : list(alphabetSize)
+{
+    for (uint32_t i = 0; i < alphabetSize; ++i) {
+        list[i] = i;
+    }
+}
+
+// the list is shifted while the symbol is searched
+template <typename nextType>
+void StageMTF::Push(const uint32_t& symbol, nextType& next)
+{
+    uint32_t previous = list[0];
+    uint32_t index = 0;
+    while (previous != symbol) {
+        std::swap(previous, list[++index]);
+    }
+    list[0] = symbol;
+    next.Push(index);
+}
+
+template <typename nextType>
+void StageMTF::PushInverse(const uint32_t& symbol, nextType& next)
+{
+    if (symbol >= list.size()) {
+        throw std::runtime_error("Wrong MTF code");
+    }
+    uint32_t rank = list[symbol];
+    for (uint32_t i = symbol; i > 0; --i) {
+        list[i] = list[i - 1];
+    }
+    list[0] = rank;
+    next.Push(rank);
+}
+
+// ==========================================================================================================
+
+template <typename nextType>
+void StageZeroRun::Push(const uint32_t& symbol, nextType& next)
+{
+    if (symbol == 0) {
+        ++runLength;
+        return;
+    }
+    Finish(next);
+    next.Push(symbol + 1);
+}
+
+template <typename nextType>
+void StageZeroRun::Finish(nextType& next)
+{
+    for (; runLength > 0; runLength = (runLength - 1) >> 1) {
+        next.Push(((runLength - 1) & 1) ? RUN_B : RUN_A);
+    }
+}
+
+template <typename nextType>
+void StageZeroRun::PushInverse(const uint32_t& symbol, nextType& next)
+{
+    if (symbol == RUN_A || symbol == RUN_B) {
+        if (runDigit == MAX_RUN_DIGITS) {
+            throw std::runtime_error("Wrong zero run");
+        }
+        runLength += uint64_t(symbol + 1) << runDigit++;
+        return;
+    }
+    FinishInverse(next);
+    next.Push(symbol - 1);
+}
+
+template <typename nextType>
+void StageZeroRun::FinishInverse(nextType& next)
+{
+    for (; runLength > 0; --runLength) {
+        next.Push(0);
+    }
+    runDigit = 0;
+}
+
+// ==========================================================================================================
+
+uint8_t StageHuffman::GetRawSymbolBits() const
+{
+    uint8_t bits = 1;
+    while (bits < 32 && (uint64_t(escape - 1) >> bits) != 0) {
+        ++bits;
+    }
+    return bits;
+}
+
+// counts of the rare symbols are moved to ESCAPE (the decoder knows them by the zero lengths)
+void StageHuffman::Write(BinaryWriter& writer)
+{
+    std::vector<uint32_t> usedSymbols;
+    for (uint32_t symbol = 0; symbol < escape; ++symbol) {
+        if (counts[symbol] > 0) {
+            usedSymbols.push_back(symbol);
+        }
+    }
+    if (usedSymbols.size() > MAX_CODED_SYMBOLS) {
+        auto codedEnd = usedSymbols.begin() + (MAX_CODED_SYMBOLS - 1);
+        std::nth_element(usedSymbols.begin(), codedEnd, usedSymbols.end(), [this](const uint32_t& a, const uint32_t& b) {
+            return counts[a] > counts[b];
+        });
+        for (auto it = codedEnd; it != usedSymbols.end(); ++it) {
+            counts[escape] += counts[*it];
+            counts[*it] = 0;
+        }
+    }
+    std::vector<uint8_t> codeLengths = GetLengthLimitedCodeLengths(counts, MAX_CODE_LENGTH);
+    std::vector<uint32_t> codes = GetCanonicalCodes(codeLengths);
+
+    BitWriter bitWriter;
+    for (const uint8_t& codeLength : codeLengths) {
+        bitWriter.WriteBits(codeLength, CODE_LENGTH_BITS);
+    }
+    uint8_t rawSymbolBits = GetRawSymbolBits();
+    for (const uint32_t& symbol : symbols) {
+        if (codeLengths[symbol] > 0) {
+            bitWriter.WriteBits(codes[symbol], codeLengths[symbol]);
+        } else {
+            bitWriter.WriteBits(codes[escape], codeLengths[escape]);
+            bitWriter.WriteBits(symbol, rawSymbolBits);
+        }
+    }
+    bitWriter.Flush();
+
+    IntegerArray::WriteVarint(writer, symbols.size());
+    IntegerArray::WriteVarint(writer, bitWriter.GetBytes().size());
+    writer.WriteBytes(bitWriter.GetBytes());
+}
+
+// every symbol takes at least one bit, so the count is checked by the size of the data
+template <typename nextType>
+void StageHuffman::Read(BinaryReader& reader, nextType& next)
+{
+    uint64_t symbolsCount = IntegerArray::ReadVarint(reader);
+    std::vector<uint8_t> bytes = reader.ReadBytes(IntegerArray::ReadVarint(reader));
+    if (symbolsCount > 8 * uint64_t(bytes.size())) {
+        throw std::runtime_error("Wrong Huffman data");
+    }
+
+    BitReader bitReader(bytes.data(), bytes.size());
+    std::vector<uint8_t> codeLengths(counts.size());
+    for (uint8_t& codeLength : codeLengths) {
+        codeLength = static_cast<uint8_t>(bitReader.ReadBits(CODE_LENGTH_BITS));
+    }
+    HuffmanDecodingTable decodingTable;
+    BuildHuffmanDecodingTable(codeLengths, decodingTable);
+
+    uint8_t rawSymbolBits = GetRawSymbolBits();
+    for (uint64_t i = 0; i < symbolsCount; ++i) {
+        uint32_t symbol = DecodeHuffmanSymbol(bitReader, decodingTable);
+        if (symbol == escape) {
+            symbol = bitReader.ReadBits(rawSymbolBits);
+            if (symbol >= escape) {
+                throw std::runtime_error("Wrong Huffman data");
+            }
+        }
+        next.Push(symbol);
+    }
+}
+
+// ==========================================================================================================
+
+// the alphabet is read before the loop, ranks are found inside of it
+template <typename... stageTypes>
+void FusedPipeline<stageTypes...>::EncodeSymbols(const std::u32string_view& input, BinaryWriter& writer)
+{
+    AlphabetMap alphabetMap(input);
+    alphabetMap.Write(writer);
+    IntegerArray::WriteVarint(writer, input.size());
+
+    chain<stageTypes...> stages(static_cast<uint32_t>(alphabetMap.GetSize()));
+    for (const char32_t& c : input) {
+        stages.Push(alphabetMap.GetRank(c));
+    }
+    stages.Finish(writer);
+}
+
+template <typename... stageTypes>
+void FusedPipeline<stageTypes...>::DecodeSymbols(BinaryReader& reader, std::u32string& output)
+{
+    AlphabetMap alphabetMap = AlphabetMap::Read(reader);
+    size_t length = IntegerArray::ReadVarint(reader);
+
+    output.clear();
+    characters outputCharacters{alphabetMap.GetAlphabet(), output, length};
+    chain<stageTypes...> stages(static_cast<uint32_t>(alphabetMap.GetSize()));
+    stages.Read(reader, outputCharacters);
+    if (output.size() != length) {
+        throw std::runtime_error("Wrong fused pipeline data");
+    }
+}
+
+// END IMPLEMENTATION
@@ -4,6 +4,12 @@
 #include <vector>
 #include <map>
 #include <utility> // for std::pair
+#include <cstdint>
+#include <numeric> // for std::iota
+#include <algorithm> // for std::sort
+#include <stdexcept>
+
+#include "BitStream.h"
 
 // START
 
@@ -117,4 +123,247 @@ std::map<char32_t, std::string> GetHuffmanCodes(HuffmanTree& tree, const size_t&
     return huffmanCodes;
 }
 
+// node of the Huffman tree stored in a flat array
+// (children are not needed to get lengths of codes)
+struct HuffmanArenaNode {
+    uint64_t freq; // after building it stores depth of the node
+    uint32_t parent;
+};
+
+// return lengths of the Huffman codes (two-queue method, O(n log n) time because of sorting)
+// all the nodes are stored in a single array without per-node allocations
+// frequencies[i] == 0 means that i-th symbol doesn't appear and gets length 0
+std::vector<uint8_t> GetHuffmanCodeLengths(const std::vector<uint64_t>& frequencies) {
+    std::vector<uint8_t> codeLengths(frequencies.size(), 0);
+
+    // indices of used symbols sorted by frequencies
+    std::vector<uint32_t> symbols;
+    for (uint32_t i = 0; i < frequencies.size(); ++i) {
+        if (frequencies[i] > 0) {
+            symbols.push_back(i);
+        }
+    }
+    std::stable_sort(symbols.begin(), symbols.end(), [&frequencies](const uint32_t& a, const uint32_t& b) {
+        return frequencies[a] < frequencies[b];
+    });
+    const uint32_t n = symbols.size();
+
+    // special cases
+    if (n == 0) {
+        return codeLengths;
+    } else if (n == 1) {
+        codeLengths[symbols[0]] = 1;
+        return codeLengths;
+    }
+
+    // nodes [0, n) are leaves, nodes [n, 2n - 1) are internal nodes
+    // leaves and internal nodes are both created in non-decreasing order of frequencies,
+    // so two queues are enough instead of a priority queue
+    std::vector<HuffmanArenaNode> nodes(2 * n - 1);
+    for (uint32_t i = 0; i < n; ++i) {
+        nodes[i].freq = frequencies[symbols[i]];
+    }
+
+    uint32_t leafPointer = 0, internalPointer = n, parent = n;
+    auto popMinimum = [&]() -> uint32_t {
+        // internal nodes in [internalPointer, parent) are not merged yet
+        if (leafPointer < n && 
+            (internalPointer == parent || nodes[leafPointer].freq <= nodes[internalPointer].freq)) {
+            return leafPointer++;
+        }
+        return internalPointer++;
+    };
+    for (; parent < 2 * n - 1; ++parent) {
+        uint32_t left = popMinimum();
+        uint32_t right = popMinimum();
+        nodes[parent].freq = nodes[left].freq + nodes[right].freq;
+        nodes[left].parent = parent;
+        nodes[right].parent = parent;
+    }
+
+    // parents always have bigger indices than children, so go from the root to the leaves
+    nodes[2 * n - 2].freq = 0;
+    for (int64_t i = 2 * n - 3; i >= 0; --i) {
+        nodes[i].freq = nodes[nodes[i].parent].freq + 1;
+    }
+    for (uint32_t i = 0; i < n; ++i) {
+        codeLengths[symbols[i]] = static_cast<uint8_t>(nodes[i].freq);
+    }
+
+    return codeLengths;
+}
+
+// return optimal lengths of the prefix codes which are not longer than maxCodeLength
+// (package-merge algorithm, O(n * maxCodeLength) time)
+// frequencies[i] == 0 means that i-th symbol doesn't appear and gets length 0
+std::vector<uint8_t> GetLengthLimitedCodeLengths(const std::vector<uint64_t>& frequencies, const uint8_t& maxCodeLength) {
+    std::vector<uint8_t> codeLengths(frequencies.size(), 0);
+
+    // indices of used symbols sorted by frequencies
+    std::vector<uint32_t> symbols;
+    for (uint32_t i = 0; i < frequencies.size(); ++i) {
+        if (frequencies[i] > 0) {
+            symbols.push_back(i);
+        }
+    }
+    std::stable_sort(symbols.begin(), symbols.end(), [&frequencies](const uint32_t& a, const uint32_t& b) {
+        return frequencies[a] < frequencies[b];
+    });
+    const size_t n = symbols.size();
+
+    // special cases
+    if (n == 0) {
+        return codeLengths;
+    } else if (n == 1) {
+        codeLengths[symbols[0]] = 1;
+        return codeLengths;
+    }
+
+    // unlimited Huffman codes are optimal if they already fit into the limit
+    std::vector<uint8_t> huffmanCodeLengths = GetHuffmanCodeLengths(frequencies);
+    if (*std::max_element(huffmanCodeLengths.begin(), huffmanCodeLengths.end()) <= maxCodeLength) {
+        return huffmanCodeLengths;
+    }
+
+    if (maxCodeLength == 0 || (maxCodeLength < 64 && n > (uint64_t(1) << maxCodeLength))) {
+        throw std::runtime_error("Can't build prefix codes of length " + std::to_string(maxCodeLength) + 
+                                 " for " + std::to_string(n) + " symbols");
+    }
+
+    // isPackage[level][i] shows if the i-th item of the list on the level is a package
+    // (level 0 is the top list, level maxCodeLength - 1 contains only leaves)
+    std::vector<std::vector<bool>> isPackage(maxCodeLength);
+    std::vector<uint64_t> weights, nextWeights;
+    weights.reserve(2 * n); nextWeights.reserve(2 * n);
+
+    // the deepest level
+    for (size_t i = 0; i < n; ++i) {
+        weights.push_back(frequencies[symbols[i]]);
+    }
+    isPackage[maxCodeLength - 1].assign(n, false);
+
+    // merge leaves with packages of the items from the deeper level
+    for (int level = maxCodeLength - 2; level >= 0; --level) {
+        size_t packagesCount = weights.size() / 2;
+        size_t leafIndex = 0, packageIndex = 0;
+        nextWeights.clear();
+        isPackage[level].clear();
+        isPackage[level].reserve(n + packagesCount);
+
+        while (leafIndex < n || packageIndex < packagesCount) {
+            uint64_t packageWeight = (packageIndex < packagesCount) ? 
+                (weights[2 * packageIndex] + weights[2 * packageIndex + 1]) : 0;
+            // on ties leaves go first
+            if (packageIndex == packagesCount || 
+                (leafIndex < n && frequencies[symbols[leafIndex]] <= packageWeight)) {
+                nextWeights.push_back(frequencies[symbols[leafIndex++]]);
+                isPackage[level].push_back(false);
+            } else {
+                nextWeights.push_back(packageWeight);
+                isPackage[level].push_back(true);
+                ++packageIndex;
+            }
+        }
+        std::swap(weights, nextWeights);
+    }
+
+    // take first 2n - 2 items of the top list and expand packages level by level
+    // every leaf taken on some level increases the code length of its symbol
+    size_t itemsCount = 2 * n - 2;
+    for (uint8_t level = 0; level < maxCodeLength && itemsCount > 0; ++level) {
+        size_t leavesCount = 0, packagesCount = 0;
+        for (size_t i = 0; i < itemsCount; ++i) {
+            if (isPackage[level][i]) {
+                ++packagesCount;
+            } else {
+                ++leavesCount;
+            }
+        }
+        // leaves in the list are sorted by frequencies
+        for (size_t i = 0; i < leavesCount; ++i) {
+            ++codeLengths[symbols[i]];
+        }
+        itemsCount = 2 * packagesCount;
+    }
+
+    return codeLengths;
+}
+
+// return canonical Huffman codes by their lengths
+// (code of the i-th symbol is stored in the lowest codeLengths[i] bits of codes[i])
+std::vector<uint32_t> GetCanonicalCodes(const std::vector<uint8_t>& codeLengths) {
+    std::vector<uint32_t> codes(codeLengths.size(), 0);
+
+    // sort symbols by (length, symbol)
+    std::vector<uint32_t> symbols(codeLengths.size());
+    std::iota(symbols.begin(), symbols.end(), 0);
+    std::stable_sort(symbols.begin(), symbols.end(), [&codeLengths](const uint32_t& a, const uint32_t& b) {
+        return codeLengths[a] < codeLengths[b];
+    });
+
+    uint32_t code = 0;
+    uint8_t previousLength = 0;
+    for (uint32_t symbol : symbols) {
+        if (codeLengths[symbol] == 0) {
+            continue;
+        }
+        if (previousLength != 0) {
+            ++code;
+        }
+        code <<= (codeLengths[symbol] - previousLength);
+        previousLength = codeLengths[symbol];
+        codes[symbol] = code;
+    }
+
+    return codes;
+}
+
+// lookup table to decode canonical Huffman codes
+// entry for every possible value of the next maxCodeLength bits is (symbol << 4) | codeLength
+struct HuffmanDecodingTable {
+    uint8_t maxCodeLength = 0;
+    std::vector<uint32_t> entries;
+};
+
+// codeLengths must not be longer than 15 and must be lengths of a prefix code (checked, they can be read from a file)
+void BuildHuffmanDecodingTable(const std::vector<uint8_t>& codeLengths, HuffmanDecodingTable& table) {
+    table.maxCodeLength = 1;
+    for (const uint8_t& codeLength : codeLengths) {
+        table.maxCodeLength = std::max(table.maxCodeLength, codeLength);
+    }
+    if (table.maxCodeLength > 15) {
+        throw std::runtime_error("Wrong Huffman code length");
+    }
+    // codes of a prefix code fill at most all the entries
+    uint64_t usedEntries = 0;
+    for (const uint8_t& codeLength : codeLengths) {
+        if (codeLength > 0) {
+            usedEntries += uint64_t(1) << (table.maxCodeLength - codeLength);
+        }
+    }
+    if (usedEntries > (uint64_t(1) << table.maxCodeLength)) {
+        throw std::runtime_error("Wrong Huffman code lengths");
+    }
+
+    std::vector<uint32_t> codes = GetCanonicalCodes(codeLengths);
+    table.entries.assign(size_t(1) << table.maxCodeLength, 0);
+
+    // every code fills all the entries which start with it
+    for (uint32_t symbol = 0; symbol < codeLengths.size(); ++symbol) {
+        if (codeLengths[symbol] == 0) {
+            continue;
+        }
+        uint8_t freeBits = table.maxCodeLength - codeLengths[symbol];
+        size_t first = size_t(codes[symbol]) << freeBits;
+        size_t last = first + (size_t(1) << freeBits);
+        std::fill(table.entries.begin() + first, table.entries.begin() + last, (symbol << 4) | codeLengths[symbol]);
+    }
+}
+
+inline uint32_t DecodeHuffmanSymbol(BitReader& reader, const HuffmanDecodingTable& table) {
+    uint32_t entry = table.entries[reader.PeekBits(table.maxCodeLength)];
+    reader.SkipBits(entry & 0xF);
+    return entry >> 4;
+}
+
 // END
\ No newline at end of file
@@ -0,0 +1,361 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define INTEGER_ARRAY_SSE2
+#endif
+
+#include "BinaryStream.h"
+
+/**
+ * Arrays of unsigned integers in the smallest of three forms:
+ * FIXED_WIDTH - all values are packed with the bit width of the maximum,
+ * FRAME_OF_REFERENCE - the minimum is stored once and the values are packed as differences from it,
+ * VARINT - every value is stored by 7 bits per byte (for few big values among small ones).
+ * array: mode (uint8_t), varint(count), [varint(minimum)], [width (uint8_t), packed bits]
+ * bits are packed from the lowest bit of the first byte, 1, 2 and 4 bit values are unpacked by 16 bytes (SSE2)
+*/
+class IntegerArray
+{
+private:
+    IntegerArray() = default;
+public:
+    enum Mode : uint8_t { FIXED_WIDTH = 0, FRAME_OF_REFERENCE = 1, VARINT = 2 };
+
+    template <typename valueType>
+    static void Write(BinaryWriter& writer, const valueType* values, const size_t& count);
+    template <typename valueType>
+    static void Write(BinaryWriter& writer, const std::vector<valueType>& values) { Write(writer, values.data(), values.size()); }
+    template <typename valueType>
+    static std::vector<valueType> Read(BinaryReader& reader);
+    // read to the container of unsigned values (std::vector, std::u32string, ...)
+    template <typename containerType>
+    static void Read(BinaryReader& reader, containerType& values);
+
+    // pack count values of width bits to output (it must have place for GetPackedSize bytes)
+    template <typename valueType>
+    static void Pack(const valueType* values, const size_t& count, const uint8_t& width, uint8_t* output);
+    // unpack count values of width bits (PADDING_SIZE bytes after the packed ones must be readable)
+    template <typename valueType>
+    static void Unpack(const uint8_t* bytes, const size_t& count, const uint8_t& width, valueType* output);
+    static size_t GetPackedSize(const size_t& count, const uint8_t& width) { return (count / 8) * width + ((count % 8) * width + 7) / 8; }
+    // number of bits of the value (0 for 0)
+    static uint8_t GetBitWidth(uint64_t value);
+
+    // varints: 7 bits per byte from the lowest ones, the highest bit shows that more bytes follow
+    static uint8_t GetVarintSize(uint64_t value);
+    static void AppendVarint(std::vector<uint8_t>& bytes, uint64_t value);
+    static uint64_t ReadVarint(const std::vector<uint8_t>& bytes, size_t& pointer);
+    static void WriteVarint(BinaryWriter& writer, uint64_t value);
+    static uint64_t ReadVarint(BinaryReader& reader);
+
+    static constexpr size_t PADDING_SIZE = 16;
+protected:
+    static constexpr uint8_t MAX_VARINT_SIZE = 10;
+
+#ifdef INTEGER_ARRAY_SSE2
+    // unpack the values of 1, 2 or 4 bits by blocks of 16 bytes, return the number of unpacked values
+    template <uint8_t width>
+    static size_t UnpackBytesSSE2(const uint8_t* bytes, const size_t& count, uint8_t* output);
+    static size_t UnpackBytesSSE2(const uint8_t* bytes, const size_t& count, const uint8_t& width, uint8_t* output);
+#endif
+};
+
+
+// START IMPLEMENTATION
+
+
+// the form is chosen by its size, fixed width wins ties (it's the fastest to decode)
+template <typename valueType>
+void IntegerArray::Write(BinaryWriter& writer, const valueType* values, const size_t& count)
+{
+    static_assert(std::is_unsigned<valueType>::value, "Only unsigned integers can be packed");
+    valueType minValue = (count == 0) ? 0 : *std::min_element(values, values + count);
+    valueType maxValue = (count == 0) ? 0 : *std::max_element(values, values + count);
+    uint8_t fixedWidth = GetBitWidth(maxValue);
+    uint8_t referenceWidth = GetBitWidth(maxValue - minValue);
+    // (packed forms have the width byte)
+    size_t fixedSize = 1 + GetPackedSize(count, fixedWidth);
+    size_t referenceSize = 1 + GetPackedSize(count, referenceWidth) + GetVarintSize(minValue);
+    size_t varintSize = 0;
+    for (size_t i = 0; i < count; ++i) {
+        varintSize += GetVarintSize(values[i]);
+    }
+
+    Mode mode = FIXED_WIDTH;
+    if (referenceSize < fixedSize && referenceSize <= varintSize) {
+        mode = FRAME_OF_REFERENCE;
+    } else if (varintSize < std::min(fixedSize, referenceSize)) {
+        mode = VARINT;
+    }
+
+    writer.WriteValue(static_cast<uint8_t>(mode));
+    WriteVarint(writer, count);
+    if (mode == VARINT) {
+        for (size_t i = 0; i < count; ++i) {
+            WriteVarint(writer, values[i]);
+        }
+        return;
+    }
+
+    uint8_t width = fixedWidth;
+    const valueType* packedValues = values;
+    std::vector<valueType> differences;
+    if (mode == FRAME_OF_REFERENCE) {
+        WriteVarint(writer, minValue);
+        width = referenceWidth;
+        differences.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+            differences[i] = values[i] - minValue;
+        }
+        packedValues = differences.data();
+    }
+    writer.WriteValue(width);
+    std::vector<uint8_t> bytes(GetPackedSize(count, width));
+    Pack(packedValues, count, width, bytes.data());
+    writer.WriteBytes(bytes);
+}
+
+template <typename valueType>
+std::vector<valueType> IntegerArray::Read(BinaryReader& reader)
+{
+    std::vector<valueType> values;
+    Read(reader, values);
+    return values;
+}
+
+template <typename containerType>
+void IntegerArray::Read(BinaryReader& reader, containerType& values)
+{
+    using valueType = typename containerType::value_type;
+    static_assert(std::is_unsigned<valueType>::value, "Only unsigned integers can be packed");
+    uint8_t mode = reader.ReadValue<uint8_t>();
+    uint64_t count = ReadVarint(reader);
+    if (mode > VARINT || count > SIZE_MAX / 64) {
+        throw std::runtime_error("Wrong integer array");
+    }
+
+    values.resize(count);
+    if (mode == VARINT) {
+        for (valueType& value : values) {
+            uint64_t varint = ReadVarint(reader);
+            if (varint > static_cast<uint64_t>(static_cast<valueType>(~valueType(0)))) {
+                throw std::runtime_error("Wrong integer array");
+            }
+            value = static_cast<valueType>(varint);
+        }
+        return;
+    }
+
+    uint64_t minValue = (mode == FRAME_OF_REFERENCE) ? ReadVarint(reader) : 0;
+    uint8_t width = reader.ReadValue<uint8_t>();
+    if (width > 8 * sizeof(valueType) || minValue > static_cast<uint64_t>(static_cast<valueType>(~valueType(0)))) {
+        throw std::runtime_error("Wrong integer array");
+    }
+    size_t packedSize = GetPackedSize(count, width);
+    std::vector<uint8_t> bytes(packedSize + PADDING_SIZE, 0);
+    reader.ReadBytes(bytes.data(), packedSize);
+    Unpack(bytes.data(), count, width, values.data());
+    if (minValue > 0) {
+        for (valueType& value : values) {
+            value += static_cast<valueType>(minValue);
+        }
+    }
+}
+
+// bits are collected in a 64-bit word which is stored when it's full
+template <typename valueType>
+void IntegerArray::Pack(const valueType* values, const size_t& count, const uint8_t& width, uint8_t* output)
+{
+    if (width == 0) {
+        return;
+    }
+    uint64_t word = 0;
+    uint8_t wordLength = 0;
+    for (size_t i = 0; i < count; ++i) {
+        uint64_t value = static_cast<uint64_t>(values[i]);
+        word |= value << wordLength;
+        if (wordLength + width < 64) {
+            wordLength += width;
+            continue;
+        }
+        BinaryWriter::StoreLittleEndian(output, word);
+        output += 8;
+        // the bits of the value which didn't fit
+        word = (wordLength == 0) ? 0 : value >> (64 - wordLength);
+        wordLength = static_cast<uint8_t>(wordLength + width - 64);
+    }
+    for (uint8_t i = 0; i < wordLength; i += 8) {
+        *output++ = static_cast<uint8_t>(word >> i);
+    }
+}
+
+// every value is taken from the 64-bit word at its first byte (and the next byte if it's wider than 56 bits)
+template <typename valueType>
+void IntegerArray::Unpack(const uint8_t* bytes, const size_t& count, const uint8_t& width, valueType* output)
+{
+    if (width == 0) {
+        std::fill(output, output + count, valueType(0));
+        return;
+    }
+    if (width == 8 * sizeof(valueType) && sizeof(valueType) == 1) {
+        std::memcpy(output, bytes, count);
+        return;
+    }
+
+    size_t i = 0;
+#ifdef INTEGER_ARRAY_SSE2
+    if (width == 1 || width == 2 || width == 4) {
+        if (sizeof(valueType) == 1) {
+            i = UnpackBytesSSE2(bytes, count, width, reinterpret_cast<uint8_t*>(output));
+        } else {
+            uint8_t block[128];
+            for (size_t blockLength = 128 / width; i + blockLength <= count; i += blockLength) {
+                UnpackBytesSSE2(bytes + i * width / 8, blockLength, width, block);
+                std::copy(block, block + blockLength, output + i);
+            }
+        }
+    }
+#endif
+
+    uint64_t mask = (width == 64) ? ~uint64_t(0) : (uint64_t(1) << width) - 1;
+    uint64_t bitPointer = uint64_t(i) * width;
+    if (width <= 56) {
+        for (; i < count; ++i, bitPointer += width) {
+            uint64_t word = BinaryReader::LoadLittleEndian<uint64_t>(bytes + (bitPointer >> 3));
+            output[i] = static_cast<valueType>((word >> (bitPointer & 7)) & mask);
+        }
+        return;
+    }
+    for (; i < count; ++i, bitPointer += width) {
+        const uint8_t* valueBytes = bytes + (bitPointer >> 3);
+        uint8_t shift = bitPointer & 7;
+        uint64_t word = BinaryReader::LoadLittleEndian<uint64_t>(valueBytes) >> shift;
+        if (shift > 0) {
+            word |= uint64_t(valueBytes[8]) << (64 - shift);
+        }
+        output[i] = static_cast<valueType>(word & mask);
+    }
+}
+
+#ifdef INTEGER_ARRAY_SSE2
+// the fields of every byte are separated by shifts and interleaved back in order (a perfect shuffle by bytes)
+template <uint8_t width>
+size_t IntegerArray::UnpackBytesSSE2(const uint8_t* bytes, const size_t& count, uint8_t* output)
+{
+    constexpr uint8_t fieldsCount = 8 / width;
+    constexpr size_t blockLength = 16 * fieldsCount;
+    const __m128i mask = _mm_set1_epi8(static_cast<char>((1 << width) - 1));
+    size_t i = 0;
+    for (; i + blockLength <= count; i += blockLength) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes + i / fieldsCount));
+        __m128i fields[fieldsCount], shuffled[fieldsCount];
+        for (uint8_t k = 0; k < fieldsCount; ++k) {
+            fields[k] = _mm_and_si128(_mm_srl_epi16(block, _mm_cvtsi32_si128(k * width)), mask);
+        }
+        for (uint8_t half = fieldsCount / 2; half > 0; half /= 2) {
+            for (uint8_t k = 0; k < fieldsCount / 2; ++k) {
+                shuffled[2 * k] = _mm_unpacklo_epi8(fields[k], fields[k + fieldsCount / 2]);
+                shuffled[2 * k + 1] = _mm_unpackhi_epi8(fields[k], fields[k + fieldsCount / 2]);
+            }
+            for (uint8_t k = 0; k < fieldsCount; ++k) {
+                fields[k] = shuffled[k];
+            }
+        }
+        for (uint8_t k = 0; k < fieldsCount; ++k) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i + 16 * k), fields[k]);
+        }
+    }
+    return i;
+}
+
+size_t IntegerArray::UnpackBytesSSE2(const uint8_t* bytes, const size_t& count, const uint8_t& width, uint8_t* output)
+{
+    switch (width) {
+        case 1: return UnpackBytesSSE2<1>(bytes, count, output);
+        case 2: return UnpackBytesSSE2<2>(bytes, count, output);
+        case 4: return UnpackBytesSSE2<4>(bytes, count, output);
+        default: return 0;
+    }
+}
+#endif
+
+// ==========================================================================================================
+
+uint8_t IntegerArray::GetBitWidth(uint64_t value)
+{
+    uint8_t width = 0;
+    while (value > 0) {
+        ++width;
+        value >>= 1;
+    }
+    return width;
+}
+
+uint8_t IntegerArray::GetVarintSize(uint64_t value)
+{
+    uint8_t size = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        ++size;
+    }
+    return size;
+}
+
+void IntegerArray::AppendVarint(std::vector<uint8_t>& bytes, uint64_t value)
+{
+    while (value >= 0x80) {
+        bytes.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    bytes.push_back(static_cast<uint8_t>(value));
+}
+
+uint64_t IntegerArray::ReadVarint(const std::vector<uint8_t>& bytes, size_t& pointer)
+{
+    uint64_t value = 0;
+    for (uint8_t i = 0; i < MAX_VARINT_SIZE; ++i) {
+        if (pointer >= bytes.size()) {
+            throw std::runtime_error("Unexpected end of varint");
+        }
+        uint8_t byte = bytes[pointer++];
+        value |= static_cast<uint64_t>(byte & 0x7F) << (7 * i);
+        if ((byte & 0x80) == 0) {
+            return value;
+        }
+    }
+    throw std::runtime_error("Wrong varint");
+}
+
+void IntegerArray::WriteVarint(BinaryWriter& writer, uint64_t value)
+{
+    while (value >= 0x80) {
+        writer.WriteValue(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    writer.WriteValue(static_cast<uint8_t>(value));
+}
+
+uint64_t IntegerArray::ReadVarint(BinaryReader& reader)
+{
+    uint64_t value = 0;
+    for (uint8_t i = 0; i < MAX_VARINT_SIZE; ++i) {
+        uint8_t byte = reader.ReadValue<uint8_t>();
+        value |= static_cast<uint64_t>(byte & 0x7F) << (7 * i);
+        if ((byte & 0x80) == 0) {
+            return value;
+        }
+    }
+    throw std::runtime_error("Wrong varint");
+}
+
+// END IMPLEMENTATION
@@ -0,0 +1,244 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define MAPPED_FILE_MMAP
+#endif
+
+/**
+ * File mapped to the memory
+ * input is a read-only span over the whole file, output is created with its final (or maximum) size
+ * and written in place. without mmap the file is read or written by one call through a buffer
+*/
+class MappedFile
+{
+public:
+    // map the whole file for reading
+    static MappedFile OpenRead(const char* filepath);
+    // create the file of this size and map it for writing
+    static MappedFile OpenWrite(const char* filepath, const size_t& size);
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    ~MappedFile();
+
+    const uint8_t* GetData() const { return data; }
+    uint8_t* GetData() { return data; }
+    size_t GetSize() const { return size; }
+    std::string_view GetView() const { return std::string_view(reinterpret_cast<const char*>(data), size); }
+
+    // read the pages of [offset, offset + length) from the disk now (to do it on another thread)
+    void Prefetch(const size_t& offset, const size_t& length) const;
+    // the written file is cut to this size when it's closed
+    void Shrink(const size_t& newSize);
+    // unmap the file (the written data is saved)
+    void Close();
+protected:
+    MappedFile() = default;
+
+    uint8_t* data = nullptr;
+    size_t size = 0;
+    bool isWritable = false;
+#ifdef MAPPED_FILE_MMAP
+    size_t mappedSize = 0;
+    int fileDescriptor = -1;
+#else
+    std::vector<uint8_t> buffer;
+    FILE* file = nullptr;
+#endif
+};
+
+
+// START IMPLEMENTATION
+
+
+#ifdef MAPPED_FILE_MMAP
+
+MappedFile MappedFile::OpenRead(const char* filepath)
+{
+    MappedFile mappedFile;
+    int fileDescriptor = open(filepath, O_RDONLY);
+    struct stat fileStat;
+    if (fileDescriptor < 0 || fstat(fileDescriptor, &fileStat) != 0) {
+        if (fileDescriptor >= 0) {
+            close(fileDescriptor);
+        }
+        throw std::runtime_error("Failed to open file " + std::string(filepath));
+    }
+
+    mappedFile.size = mappedFile.mappedSize = static_cast<size_t>(fileStat.st_size);
+    if (mappedFile.size > 0) {
+        void* address = mmap(nullptr, mappedFile.size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+        if (address == MAP_FAILED) {
+            close(fileDescriptor);
+            throw std::runtime_error("Failed to map file " + std::string(filepath));
+        }
+        madvise(address, mappedFile.size, MADV_SEQUENTIAL);
+        mappedFile.data = static_cast<uint8_t*>(address);
+    }
+    // the mapping stays valid without the descriptor
+    close(fileDescriptor);
+    return mappedFile;
+}
+
+MappedFile MappedFile::OpenWrite(const char* filepath, const size_t& size)
+{
+    MappedFile mappedFile;
+    mappedFile.isWritable = true;
+    mappedFile.fileDescriptor = open(filepath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (mappedFile.fileDescriptor < 0) {
+        throw std::runtime_error("Failed to open file " + std::string(filepath));
+    }
+    if (ftruncate(mappedFile.fileDescriptor, static_cast<off_t>(size)) != 0) {
+        throw std::runtime_error("Failed to resize file " + std::string(filepath));
+    }
+
+    mappedFile.size = mappedFile.mappedSize = size;
+    if (size > 0) {
+        void* address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, mappedFile.fileDescriptor, 0);
+        if (address == MAP_FAILED) {
+            throw std::runtime_error("Failed to map file " + std::string(filepath));
+        }
+        madvise(address, size, MADV_SEQUENTIAL);
+        mappedFile.data = static_cast<uint8_t*>(address);
+    }
+    return mappedFile;
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept :
+    data(other.data), size(other.size), isWritable(other.isWritable), mappedSize(other.mappedSize), fileDescriptor(other.fileDescriptor)
+{
+    other.data = nullptr;
+    other.size = other.mappedSize = 0;
+    other.fileDescriptor = -1;
+}
+
+void MappedFile::Close()
+{
+    if (data != nullptr) {
+        munmap(data, mappedSize);
+        data = nullptr;
+    }
+    if (fileDescriptor >= 0) {
+        if (isWritable && size < mappedSize && ftruncate(fileDescriptor, static_cast<off_t>(size)) != 0) {
+            close(fileDescriptor);
+            fileDescriptor = -1;
+            throw std::runtime_error("Failed to resize mapped file");
+        }
+        close(fileDescriptor);
+        fileDescriptor = -1;
+    }
+}
+
+// the kernel starts reading ahead, then every page is touched to wait for it
+void MappedFile::Prefetch(const size_t& offset, const size_t& length) const
+{
+    if (data == nullptr || offset >= size) {
+        return;
+    }
+    size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t begin = offset - offset % pageSize;
+    size_t end = std::min(size, offset + length);
+    madvise(data + begin, end - begin, MADV_WILLNEED);
+    const volatile uint8_t* bytes = data;
+    for (size_t i = begin; i < end; i += pageSize) {
+        (void)bytes[i];
+    }
+}
+
+#else
+
+MappedFile MappedFile::OpenRead(const char* filepath)
+{
+    MappedFile mappedFile;
+    FILE* file = fopen(filepath, "rb");
+    if (file == nullptr) {
+        throw std::runtime_error("Failed to open file " + std::string(filepath));
+    }
+    fseek(file, 0, SEEK_END);
+    long fileSize = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    mappedFile.buffer.resize((fileSize > 0) ? static_cast<size_t>(fileSize) : 0);
+    bool isRead = mappedFile.buffer.empty() || fread(mappedFile.buffer.data(), 1, mappedFile.buffer.size(), file) == mappedFile.buffer.size();
+    fclose(file);
+    if (!isRead) {
+        throw std::runtime_error("Failed to read file " + std::string(filepath));
+    }
+    mappedFile.data = mappedFile.buffer.data();
+    mappedFile.size = mappedFile.buffer.size();
+    return mappedFile;
+}
+
+MappedFile MappedFile::OpenWrite(const char* filepath, const size_t& size)
+{
+    MappedFile mappedFile;
+    mappedFile.isWritable = true;
+    mappedFile.file = fopen(filepath, "wb");
+    if (mappedFile.file == nullptr) {
+        throw std::runtime_error("Failed to open file " + std::string(filepath));
+    }
+    mappedFile.buffer.resize(size);
+    mappedFile.data = mappedFile.buffer.data();
+    mappedFile.size = size;
+    return mappedFile;
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept :
+    data(other.data), size(other.size), isWritable(other.isWritable), buffer(std::move(other.buffer)), file(other.file)
+{
+    other.data = nullptr;
+    other.size = 0;
+    other.file = nullptr;
+}
+
+void MappedFile::Close()
+{
+    if (file != nullptr) {
+        bool isWritten = (size == 0 || fwrite(buffer.data(), 1, size, file) == size);
+        fclose(file);
+        file = nullptr;
+        if (!isWritten) {
+            throw std::runtime_error("Failed to write mapped file");
+        }
+    }
+    data = nullptr;
+    buffer.clear();
+}
+
+// the whole file is already in the buffer
+void MappedFile::Prefetch(const size_t&, const size_t&) const
+{
+}
+
+#endif
+
+void MappedFile::Shrink(const size_t& newSize)
+{
+    if (newSize < size) {
+        size = newSize;
+    }
+}
+
+// errors of closing are lost here, Close can be called before to get them
+MappedFile::~MappedFile()
+{
+    try {
+        Close();
+    } catch (...) {
+    }
+}
+
+// END IMPLEMENTATION
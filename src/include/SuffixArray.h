@@ -2,6 +2,7 @@
 
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <algorithm>
 #include <vector>
 
@@ -26,7 +27,8 @@ std::vector<unsigned int> buildSuffixArray(std::u32string txt)
 	std::vector<Suffix> suffixes; suffixes.reserve(txt.size());
 
 	for (size_t i = 0; i < txt.size(); ++i) {
-        suffixes.push_back(Suffix(i, txt[i] - 'a', ((i+1) < txt.size()) ? (txt[i + 1] - 'a'): -1));
+        // code points are ranks, so the end (-1) is smaller than all the characters
+        suffixes.push_back(Suffix(i, static_cast<int>(txt[i]), ((i+1) < txt.size()) ? static_cast<int>(txt[i + 1]): -1));
 	}
 	std::sort(suffixes.begin(), suffixes.end(), cmp);
 
@@ -51,6 +53,10 @@ std::vector<unsigned int> buildSuffixArray(std::u32string txt)
 			}
 			ind[suffixes[i].index] = i;
 		}
+		// all the suffixes are already different
+		if (rank + 1 == static_cast<int>(txt.size())) {
+			break;
+		}
 
 		unsigned int nextindex;
 		for (size_t i = 0; i < txt.size(); ++i) {
@@ -70,4 +76,80 @@ std::vector<unsigned int> buildSuffixArray(std::u32string txt)
 	return suffixArr;
 }
 
+// suffix array of bytes (they are compared as unsigned)
+std::vector<unsigned int> buildSuffixArray(const std::string_view& txt)
+{
+	std::u32string wideTxt(txt.size(), U'\0');
+	for (size_t i = 0; i < txt.size(); ++i) {
+		wideTxt[i] = static_cast<unsigned char>(txt[i]);
+	}
+	return buildSuffixArray(wideTxt);
+}
+
+// lcp[i] - longest common prefix of suffixes suffixArr[i - 1] and suffixArr[i], lcp[0] = 0
+// (Kasai's algorithm, O(n))
+template <typename stringType>
+std::vector<unsigned int> buildLCPArray(const stringType& txt, const std::vector<unsigned int>& suffixArr)
+{
+	std::vector<unsigned int> rank(txt.size());
+	for (size_t i = 0; i < suffixArr.size(); ++i) {
+		rank[suffixArr[i]] = i;
+	}
+
+	std::vector<unsigned int> lcp(txt.size(), 0);
+	// lcp of the next suffix in the text is smaller at most by 1
+	unsigned int length = 0;
+	for (size_t i = 0; i < txt.size(); ++i) {
+		if (rank[i] == 0) {
+			length = 0;
+			continue;
+		}
+		size_t j = suffixArr[rank[i] - 1];
+		while (i + length < txt.size() && j + length < txt.size() && txt[i + length] == txt[j + length]) {
+			++length;
+		}
+		lcp[rank[i]] = length;
+		if (length > 0) {
+			--length;
+		}
+	}
+
+	return lcp;
+}
+
+// lpf[i] - longest previous factor (the longest prefix of suffix i which starts before i too),
+// prevOcc[i] - start of its previous occurrence (-1 if lpf[i] is 0).
+// the previous occurrence is the nearest suffix with the smaller index before or after i in the suffix array,
+// they are found with the stack in O(n) (Crochemore and Ilie)
+void buildLongestPreviousFactors(const std::vector<unsigned int>& suffixArr, const std::vector<unsigned int>& lcp,
+                                 std::vector<unsigned int>& lpf, std::vector<int>& prevOcc)
+{
+	const size_t n = suffixArr.size();
+	lpf.assign(n, 0);
+	prevOcc.assign(n, -1);
+
+	// indices in the suffix array with increasing suffixes and lcp with the previous element of the stack
+	std::vector<std::pair<unsigned int, unsigned int>> stack;
+	for (size_t i = 0; i <= n; ++i) {
+		// lcp of the current suffix and the top of the stack
+		unsigned int length = (i < n) ? lcp[i] : 0;
+		while (!stack.empty() && (i == n || suffixArr[stack.back().first] > suffixArr[i])) {
+			unsigned int top = suffixArr[stack.back().first];
+			unsigned int previousLength = stack.back().second;
+			stack.pop_back();
+			if (previousLength >= length && previousLength > 0) {
+				lpf[top] = previousLength;
+				prevOcc[top] = suffixArr[stack.back().first];
+			} else if (length > 0) {
+				lpf[top] = length;
+				prevOcc[top] = suffixArr[i];
+			}
+			length = std::min(length, previousLength);
+		}
+		if (i < n) {
+			stack.push_back(std::make_pair(i, stack.empty() ? 0 : length));
+		}
+	}
+}
+
 // END
@@ -0,0 +1,219 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <exception>
+#include <algorithm>
+#include <type_traits>
+
+/**
+ * Queue of at most capacity values between threads
+ * Push waits for a place and Pop waits for a value. Close wakes them all:
+ * the closed queue takes no values and gives the rest of them
+*/
+template <typename valueType>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(const size_t& capacity) : capacity(std::max<size_t>(1, capacity)) {}
+
+    // return false if the queue is closed
+    bool Push(valueType value);
+    // return false if the queue is closed and empty
+    bool Pop(valueType& value);
+    void Close();
+private:
+    size_t capacity;
+    std::deque<valueType> values;
+    bool isClosed = false;
+    std::mutex mutex;
+    std::condition_variable notFull, notEmpty;
+};
+
+class ThreadUtils
+{
+private:
+    ThreadUtils() = default;
+public:
+    // number of threads of the hardware (at least 1)
+    static uint32_t GetHardwareThreadsCount();
+
+    // blocks 0, ..., blocksCount - 1 go through three stages which work at the same time:
+    // readBlock(index) on the reader thread, computeBlock(input, index) on threadsCount threads (including the current one)
+    // and writeBlock(output, index) on the writer thread in the order of the blocks.
+    // at most capacity blocks wait for computing and for writing, so the memory is bounded.
+    // the first exception stops all the stages and is rethrown when all the threads are finished
+    template <typename ReadFunction, typename ComputeFunction, typename WriteFunction>
+    static void RunPipeline(const size_t& blocksCount, const uint32_t& threadsCount, const size_t& capacity,
+                            ReadFunction readBlock, ComputeFunction computeBlock, WriteFunction writeBlock);
+    // the same without the writer (computeBlock returns nothing)
+    template <typename ReadFunction, typename ComputeFunction>
+    static void RunPipeline(const size_t& blocksCount, const uint32_t& threadsCount, const size_t& capacity,
+                            ReadFunction readBlock, ComputeFunction computeBlock);
+};
+
+
+// START IMPLEMENTATION
+
+
+template <typename valueType>
+bool BoundedQueue<valueType>::Push(valueType value)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    notFull.wait(lock, [this]() { return isClosed || values.size() < capacity; });
+    if (isClosed) {
+        return false;
+    }
+    values.push_back(std::move(value));
+    notEmpty.notify_one();
+    return true;
+}
+
+template <typename valueType>
+bool BoundedQueue<valueType>::Pop(valueType& value)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    notEmpty.wait(lock, [this]() { return isClosed || !values.empty(); });
+    if (values.empty()) {
+        return false;
+    }
+    value = std::move(values.front());
+    values.pop_front();
+    notFull.notify_one();
+    return true;
+}
+
+template <typename valueType>
+void BoundedQueue<valueType>::Close()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    isClosed = true;
+    notFull.notify_all();
+    notEmpty.notify_all();
+}
+
+// ==========================================================================================================
+
+uint32_t ThreadUtils::GetHardwareThreadsCount()
+{
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// computed blocks wait in the map until all the previous blocks are written,
+// a block isn't put there while it's capacity or more blocks after the next one to write
+template <typename ReadFunction, typename ComputeFunction, typename WriteFunction>
+void ThreadUtils::RunPipeline(const size_t& blocksCount, const uint32_t& threadsCount, const size_t& capacity,
+                              ReadFunction readBlock, ComputeFunction computeBlock, WriteFunction writeBlock)
+{
+    using inputType = std::decay_t<std::invoke_result_t<ReadFunction&, const size_t&>>;
+    using outputType = std::decay_t<std::invoke_result_t<ComputeFunction&, inputType&, const size_t&>>;
+
+    BoundedQueue<std::pair<size_t, inputType>> readBlocks(capacity);
+    std::map<size_t, outputType> computedBlocks;
+    size_t nextBlockToWrite = 0;
+    bool isStopped = false;
+    std::exception_ptr exception;
+    std::mutex mutex;
+    std::condition_variable blockComputed, blockWritten;
+
+    auto stop = [&]() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!exception) {
+                exception = std::current_exception();
+            }
+            isStopped = true;
+            blockComputed.notify_all();
+            blockWritten.notify_all();
+        }
+        readBlocks.Close();
+    };
+
+    auto reader = [&]() {
+        try {
+            for (size_t i = 0; i < blocksCount; ++i) {
+                if (!readBlocks.Push(std::make_pair(i, readBlock(i)))) {
+                    break;
+                }
+            }
+        } catch (...) {
+            stop();
+        }
+        readBlocks.Close();
+    };
+
+    auto worker = [&]() {
+        std::pair<size_t, inputType> block;
+        while (readBlocks.Pop(block)) {
+            try {
+                outputType output = computeBlock(block.second, block.first);
+                std::unique_lock<std::mutex> lock(mutex);
+                blockWritten.wait(lock, [&]() { return isStopped || block.first < nextBlockToWrite + capacity; });
+                if (isStopped) {
+                    return;
+                }
+                computedBlocks.emplace(block.first, std::move(output));
+                blockComputed.notify_all();
+            } catch (...) {
+                stop();
+                return;
+            }
+        }
+    };
+
+    auto writer = [&]() {
+        try {
+            for (size_t i = 0; i < blocksCount; ++i) {
+                std::unique_lock<std::mutex> lock(mutex);
+                blockComputed.wait(lock, [&]() { return isStopped || computedBlocks.count(i) > 0; });
+                if (isStopped) {
+                    return;
+                }
+                outputType output = std::move(computedBlocks.at(i));
+                computedBlocks.erase(i);
+                lock.unlock();
+
+                writeBlock(output, i);
+
+                lock.lock();
+                nextBlockToWrite = i + 1;
+                blockWritten.notify_all();
+            }
+        } catch (...) {
+            stop();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.emplace_back(reader);
+    threads.emplace_back(writer);
+    for (size_t i = 1; i < std::min<size_t>(threadsCount, blocksCount); ++i) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    if (exception) {
+        std::rethrow_exception(exception);
+    }
+}
+
+template <typename ReadFunction, typename ComputeFunction>
+void ThreadUtils::RunPipeline(const size_t& blocksCount, const uint32_t& threadsCount, const size_t& capacity,
+                              ReadFunction readBlock, ComputeFunction computeBlock)
+{
+    using inputType = std::decay_t<std::invoke_result_t<ReadFunction&, const size_t&>>;
+    RunPipeline(blocksCount, threadsCount, capacity, readBlock, [&](inputType& input, const size_t& index) {
+        computeBlock(input, index);
+        return true;
+    }, [](const bool&, const size_t&) {});
+}
+
+// END IMPLEMENTATION
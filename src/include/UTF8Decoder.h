@@ -0,0 +1,202 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define UTF8_DECODER_SSE2
+#endif
+
+/**
+ * Validating UTF-8 -> UTF-32 decoder of memory buffers
+ * ASCII is converted by 16 bytes (SSE2), runs of 2-byte characters (Cyrillic, Greek, ...) with ASCII between them
+ * have their own loop, other characters go through the full check
+ * (no overlong forms, surrogates and code points after U+10FFFF)
+*/
+class UTF8Decoder
+{
+private:
+    UTF8Decoder() = default;
+public:
+    // decode size bytes to output (it must have place for size characters),
+    // return the number of characters
+    static size_t Decode(const uint8_t* bytes, const size_t& size, char32_t* output);
+    static std::u32string Decode(const std::string& str);
+    // decode the first count characters of size bytes to output (throw if there are less characters),
+    // return the number of used bytes
+    static size_t DecodePrefix(const uint8_t* bytes, const size_t& size, const size_t& count, char32_t* output);
+    // size of the bytes without the incomplete character at the end (for decoding by chunks),
+    // the bytes themselves are checked by Decode
+    static size_t GetCompleteSize(const uint8_t* bytes, const size_t& size);
+protected:
+    static constexpr size_t ASCII_BLOCK_SIZE = 16;
+
+    // decode 3 and 4 byte characters (and throw on invalid bytes), return the length of the character
+    static size_t DecodeLongChar(const uint8_t* bytes, const size_t& size, char32_t& code_point);
+    static bool IsContinuation(const uint8_t& byte) { return (byte & 0b11000000) == 0b10000000; }
+    // decode at most maxCount characters, return the number of used bytes
+    static size_t DecodeChars(const uint8_t* bytes, const size_t& size, const size_t& maxCount, char32_t* output, size_t& count);
+};
+
+
+// START IMPLEMENTATION
+
+
+size_t UTF8Decoder::DecodeLongChar(const uint8_t* bytes, const size_t& size, char32_t& code_point)
+{
+    // the range of the second byte excludes overlong forms, surrogates and too big code points
+    size_t length;
+    uint8_t secondMin = 0x80, secondMax = 0xBF;
+    if (bytes[0] >= 0xE0 && bytes[0] <= 0xEF) {
+        length = 3;
+        code_point = bytes[0] & 0b00001111;
+        if (bytes[0] == 0xE0) {
+            secondMin = 0xA0;
+        } else if (bytes[0] == 0xED) {
+            secondMax = 0x9F;
+        }
+    } else if (bytes[0] >= 0xF0 && bytes[0] <= 0xF4) {
+        length = 4;
+        code_point = bytes[0] & 0b00000111;
+        if (bytes[0] == 0xF0) {
+            secondMin = 0x90;
+        } else if (bytes[0] == 0xF4) {
+            secondMax = 0x8F;
+        }
+    } else {
+        throw std::runtime_error("Can't decode byte in UTF-8");
+    }
+
+    if (size < length || bytes[1] < secondMin || bytes[1] > secondMax) {
+        throw std::runtime_error("Can't decode byte in UTF-8");
+    }
+    for (size_t i = 1; i < length; ++i) {
+        if (!IsContinuation(bytes[i])) {
+            throw std::runtime_error("Can't decode byte in UTF-8");
+        }
+        code_point = (code_point << 6) | (bytes[i] & 0b00111111);
+    }
+    return length;
+}
+
+size_t UTF8Decoder::DecodeChars(const uint8_t* bytes, const size_t& size, const size_t& maxCount, char32_t* output, size_t& count)
+{
+    size_t i = 0;
+    count = 0;
+    while (i < size && count < maxCount) {
+        // blocks of ASCII
+#ifdef UTF8_DECODER_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        while (i + ASCII_BLOCK_SIZE <= size && count + ASCII_BLOCK_SIZE <= maxCount) {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes + i));
+            if (_mm_movemask_epi8(block) != 0) {
+                break;
+            }
+            __m128i low = _mm_unpacklo_epi8(block, zero);
+            __m128i high = _mm_unpackhi_epi8(block, zero);
+            __m128i* destination = reinterpret_cast<__m128i*>(output + count);
+            _mm_storeu_si128(destination, _mm_unpacklo_epi16(low, zero));
+            _mm_storeu_si128(destination + 1, _mm_unpackhi_epi16(low, zero));
+            _mm_storeu_si128(destination + 2, _mm_unpacklo_epi16(high, zero));
+            _mm_storeu_si128(destination + 3, _mm_unpackhi_epi16(high, zero));
+            i += ASCII_BLOCK_SIZE;
+            count += ASCII_BLOCK_SIZE;
+        }
+#else
+        while (i + sizeof(uint64_t) <= size && count + sizeof(uint64_t) <= maxCount) {
+            uint64_t word;
+            std::memcpy(&word, bytes + i, sizeof(uint64_t));
+            if ((word & 0x8080808080808080ull) != 0) {
+                break;
+            }
+            for (size_t j = 0; j < sizeof(uint64_t); ++j) {
+                output[count++] = bytes[i++];
+            }
+        }
+#endif
+        if (i == size || count == maxCount) {
+            break;
+        }
+
+        // 2-byte characters and single ASCII characters between them
+        while (i + 1 < size && count < maxCount) {
+            uint8_t byte = bytes[i];
+            if (byte < 0x80) {
+                output[count++] = byte;
+                ++i;
+            } else if (byte >= 0xC2 && byte <= 0xDF && IsContinuation(bytes[i + 1])) {
+                output[count++] = (char32_t(byte & 0b00011111) << 6) | (bytes[i + 1] & 0b00111111);
+                i += 2;
+            } else {
+                break;
+            }
+            // go back to blocks after a long run of ASCII
+            if (byte < 0x80 && i + ASCII_BLOCK_SIZE <= size && bytes[i] < 0x80 && bytes[i + 1] < 0x80) {
+                break;
+            }
+        }
+        if (i == size || count == maxCount) {
+            break;
+        }
+
+        uint8_t byte = bytes[i];
+        if (byte < 0x80) {
+            output[count++] = byte;
+            ++i;
+        } else if (byte >= 0xC2 && byte <= 0xDF) {
+            // the last byte or a wrong continuation (a valid pair is decoded above)
+            if (i + 1 == size || !IsContinuation(bytes[i + 1])) {
+                throw std::runtime_error("Can't decode byte in UTF-8");
+            }
+            output[count++] = (char32_t(byte & 0b00011111) << 6) | (bytes[i + 1] & 0b00111111);
+            i += 2;
+        } else {
+            i += DecodeLongChar(bytes + i, size - i, output[count++]);
+        }
+    }
+    return i;
+}
+
+size_t UTF8Decoder::Decode(const uint8_t* bytes, const size_t& size, char32_t* output)
+{
+    size_t count;
+    DecodeChars(bytes, size, size, output, count);
+    return count;
+}
+
+size_t UTF8Decoder::DecodePrefix(const uint8_t* bytes, const size_t& size, const size_t& count, char32_t* output)
+{
+    size_t decodedCount;
+    size_t usedBytes = DecodeChars(bytes, size, count, output, decodedCount);
+    if (decodedCount != count) {
+        throw std::runtime_error("Can't decode byte in UTF-8");
+    }
+    return usedBytes;
+}
+
+std::u32string UTF8Decoder::Decode(const std::string& str)
+{
+    std::u32string result(str.size(), U'\0');
+    result.resize(Decode(reinterpret_cast<const uint8_t*>(str.data()), str.size(), &result[0]));
+    return result;
+}
+
+// the lead byte of the last character is at most 3 bytes before the end
+size_t UTF8Decoder::GetCompleteSize(const uint8_t* bytes, const size_t& size)
+{
+    for (size_t back = 1; back <= std::min<size_t>(4, size); ++back) {
+        uint8_t byte = bytes[size - back];
+        if (IsContinuation(byte)) {
+            continue;
+        }
+        size_t length = (byte >= 0xF0) ? 4 : (byte >= 0xE0) ? 3 : (byte >= 0xC0) ? 2 : 1;
+        return (length > back) ? size - back : size;
+    }
+    return size;
+}
+
+// END IMPLEMENTATION
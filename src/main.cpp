@@ -16,6 +16,10 @@
 #include "include/CodecMTF.h"
 #include "include/CodecAC.h"
 #include "include/CodecHA.h"
+#include "include/CodecAdaptiveHA.h"
+#include "include/CodecLZ77.h"
+#include "include/CodecLZ77HA.h"
+#include "include/CodecLZW.h"
 
 namespace fs = std::filesystem;
 const fs::path INPUT_DIR = fs::current_path() / "..\\input";
@@ -0,0 +1,67 @@
+// round trips of CodecHA and of the compressors with HA stages through files
+// g++ -std=c++17 -O2 CodecHATest.cpp && ./a.out (returns the number of failed checks)
+
+#include <iostream>
+#include <string>
+#include <random>
+#include <filesystem>
+
+#include "../include/FileUtils.h"
+#include "../include/CodecUTF8.h"
+#include "../include/CodecHA.h"
+#include "../include/CodecPipeline.h"
+
+namespace fs = std::filesystem;
+
+// random text of the first alphabetSize code points (without surrogates), every segment of it has most of them
+std::string MakeText(const size_t& alphabetSize, const size_t& length)
+{
+    std::u32string alphabet;
+    for (char32_t c = 1; alphabet.size() < alphabetSize; ++c) {
+        if (c < 0xD800 || c > 0xDFFF) {
+            alphabet.push_back(c);
+        }
+    }
+    std::u32string text;
+    std::mt19937 random(1);
+    std::uniform_int_distribution<size_t> rank(0, alphabetSize - 1);
+    while (text.size() < length) {
+        text.push_back(alphabet[rank(random)]);
+    }
+    return CodecUTF8::EncodeString32ToString(text);
+}
+
+template <typename CodecType>
+int CheckRoundTrip(const std::string& codecName, const std::string& text)
+{
+    const std::string inputPath = (fs::temp_directory_path() / "codec_test_input.txt").string();
+    const std::string encodedPath = (fs::temp_directory_path() / "codec_test_encoded.bin").string();
+    const std::string decodedPath = (fs::temp_directory_path() / "codec_test_decoded.txt").string();
+    FileUtils::WriteContent(inputPath.c_str(), text);
+    CodecType::Encode(inputPath.c_str(), encodedPath.c_str());
+    CodecType::Decode(encodedPath.c_str(), decodedPath.c_str());
+    if (FileUtils::ReadContentToString(decodedPath.c_str()) != text) {
+        std::cout << codecName << ": wrong round trip of " << text.size() << " bytes\n";
+        return 1;
+    }
+    return 0;
+}
+
+
+int main()
+{
+    int failed = 0;
+    // blocks can't have more characters than the codes of 15 bits, so the big alphabets are split
+    for (const size_t& alphabetSize : {size_t(1), size_t(300), size_t(1) << 15, (size_t(1) << 15) + 5000, size_t(40000)}) {
+        std::string text = MakeText(alphabetSize, 100000);
+        failed += CheckRoundTrip<CodecHA>("CodecHA", text);
+        failed += CheckRoundTrip<CompressorHA>("CompressorHA", text);
+        failed += CheckRoundTrip<CompressorBWT_MTF_HA>("CompressorBWT_MTF_HA", text);
+        failed += CheckRoundTrip<CompressorBWT_MTF_RLE_HA>("CompressorBWT_MTF_RLE_HA", text);
+    }
+    failed += CheckRoundTrip<CodecHA>("CodecHA", "");
+    failed += CheckRoundTrip<CompressorHA>("CompressorHA", "");
+
+    std::cout << ((failed == 0) ? "OK" : "FAILED") << "\n";
+    return failed;
+}
@@ -0,0 +1,72 @@
+// round trips of FusedPipeline and of CodecPipeline with MTF_ZR_HA
+// g++ -std=c++17 -O2 FusedPipelineTest.cpp && ./a.out (returns the number of failed checks)
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <random>
+
+#include "../include/CodecPipeline.h"
+
+using FusedMTF_ZR_HA = FusedPipeline<StageMTF, StageZeroRun, StageHuffman>;
+
+// the first alphabetSize code points (without surrogates) in order (MTF gives all the ranks to them),
+// then random ones of them with geometric distribution
+std::u32string MakeText(const size_t& alphabetSize, const size_t& length)
+{
+    std::u32string alphabet;
+    for (char32_t c = 1; alphabet.size() < alphabetSize; ++c) {
+        if (c < 0xD800 || c > 0xDFFF) {
+            alphabet.push_back(c);
+        }
+    }
+    std::u32string text = alphabet;
+    std::mt19937 random(1);
+    std::geometric_distribution<size_t> rank(0.05);
+    while (text.size() < length) {
+        text.push_back(alphabet[rank(random) % alphabetSize]);
+    }
+    return text;
+}
+
+int CheckFused(const std::u32string& text)
+{
+    BinaryWriter writer;
+    FusedMTF_ZR_HA::EncodeSymbols(text, writer);
+    BinaryReader reader(writer.GetData(), writer.GetSize());
+    std::u32string decoded;
+    FusedMTF_ZR_HA::DecodeSymbols(reader, decoded);
+    if (decoded != text) {
+        std::cout << "FusedPipeline: wrong round trip of " << text.size() << " symbols\n";
+        return 1;
+    }
+    return 0;
+}
+
+int CheckPipeline(const std::u32string& text)
+{
+    std::string str = CodecUTF8::EncodeString32ToString(text);
+    std::vector<uint8_t> encoded = CodecPipeline({CodecPipeline::BWT, CodecPipeline::MTF_ZR_HA}).Encode(str);
+    if (CodecPipeline({}).Decode(encoded.data(), encoded.size()) != str) {
+        std::cout << "CodecPipeline: wrong round trip of " << text.size() << " symbols\n";
+        return 1;
+    }
+    return 0;
+}
+
+
+int main()
+{
+    int failed = 0;
+    // the alphabet above 2^15 has more symbols than the Huffman codes of 15 bits
+    for (const size_t& alphabetSize : {size_t(1), size_t(2), size_t(300), size_t(1) << 15, (size_t(1) << 15) + 5000}) {
+        std::u32string text = MakeText(alphabetSize, 200000);
+        failed += CheckFused(text);
+        failed += CheckPipeline(text);
+    }
+    failed += CheckFused(U"");
+    failed += CheckPipeline(U"");
+
+    std::cout << ((failed == 0) ? "OK" : "FAILED") << "\n";
+    return failed;
+}